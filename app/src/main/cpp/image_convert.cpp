@@ -0,0 +1,260 @@
+#include "image_convert.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// Every block is fully loaded before its (smaller) output is stored, and later blocks are read
+// from beyond anything written so far, so all paths are safe with dst == src.
+void rgba_to_rgb(uint8_t * dst, const uint8_t * src, size_t n_pixels) {
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    // 16 pixels per step: de-interleaving load, then interleaving store of three planes
+    for (; i + 16 <= n_pixels; i += 16) {
+        uint8x16x4_t rgba = vld4q_u8(src + i * 4);
+        uint8x16x3_t rgb  = { { rgba.val[0], rgba.val[1], rgba.val[2] } };
+        vst3q_u8(dst + i * 3, rgb);
+    }
+#elif defined(__SSSE3__)
+    // 16 pixels per step: pack each 4-pixel vector to 12 bytes, then stitch them into 3 stores
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    for (; i + 16 <= n_pixels; i += 16) {
+        const uint8_t * s = src + i * 4;
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (s +  0)), pack);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (s + 16)), pack);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (s + 32)), pack);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (s + 48)), pack);
+
+        uint8_t * o = dst + i * 3;
+        _mm_storeu_si128((__m128i *) (o +  0), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128((__m128i *) (o + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128((__m128i *) (o + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+    }
+#endif
+
+    for (; i < n_pixels; i++) {
+        dst[i * 3 + 0] = src[i * 4 + 0];
+        dst[i * 3 + 1] = src[i * 4 + 1];
+        dst[i * 3 + 2] = src[i * 4 + 2];
+    }
+}
+
+// BT.601 full-range (JFIF, what Camera2 YUV_420_888 carries) in 6-bit fixed point. Every
+// intermediate fits in int16, so the NEON, SSSE3 and scalar paths produce identical pixels.
+static inline uint8_t clamp_q6(int v) {
+    v = (v + 32) >> 6;
+    return (uint8_t) (v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+static void yuv_row_to_rgba(uint8_t * dst, const uint8_t * y, const uint8_t * u, const uint8_t * v,
+                            int n) {
+    int i = 0;
+
+#if defined(__ARM_NEON)
+    const uint8x8_t bias  = vdup_n_u8(128);
+    const uint8x8_t alpha = vdup_n_u8(255);
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t yy = vreinterpretq_s16_u16(vshll_n_u8(vld1_u8(y + i), 6));
+        const int16x8_t uu = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + i), bias));
+        const int16x8_t vv = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + i), bias));
+
+        uint8x8x4_t rgba;
+        rgba.val[0] = vqrshrun_n_s16(vmlaq_n_s16(yy, vv, 90), 6);
+        rgba.val[1] = vqrshrun_n_s16(vmlsq_n_s16(vmlsq_n_s16(yy, uu, 22), vv, 46), 6);
+        rgba.val[2] = vqrshrun_n_s16(vmlaq_n_s16(yy, uu, 113), 6);
+        rgba.val[3] = alpha;
+        vst4_u8(dst + i * 4, rgba);
+    }
+#elif defined(__SSSE3__)
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i bias  = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi16(32);
+    const __m128i alpha = _mm_set1_epi8((char) 255);
+    auto widen = [zero](const uint8_t * p) {
+        return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) p), zero);
+    };
+    auto narrow = [zero, round](__m128i x) {
+        return _mm_packus_epi16(_mm_srai_epi16(_mm_add_epi16(x, round), 6), zero);
+    };
+    for (; i + 8 <= n; i += 8) {
+        const __m128i yy = _mm_slli_epi16(widen(y + i), 6);
+        const __m128i uu = _mm_sub_epi16(widen(u + i), bias);
+        const __m128i vv = _mm_sub_epi16(widen(v + i), bias);
+
+        const __m128i r = narrow(_mm_add_epi16(yy, _mm_mullo_epi16(vv, _mm_set1_epi16(90))));
+        const __m128i g = narrow(_mm_sub_epi16(_mm_sub_epi16(yy, _mm_mullo_epi16(uu, _mm_set1_epi16(22))),
+                                               _mm_mullo_epi16(vv, _mm_set1_epi16(46))));
+        const __m128i b = narrow(_mm_add_epi16(yy, _mm_mullo_epi16(uu, _mm_set1_epi16(113))));
+
+        // r0 g0 r1 g1 ... and b0 a0 b1 a1 ..., then interleaved as pixel-sized pairs
+        const __m128i rg = _mm_unpacklo_epi8(r, g);
+        const __m128i ba = _mm_unpacklo_epi8(b, alpha);
+        _mm_storeu_si128((__m128i *) (dst + i * 4),      _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *) (dst + i * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+
+    for (; i < n; i++) {
+        const int yy = y[i] << 6;
+        const int uu = u[i] - 128;
+        const int vv = v[i] - 128;
+        dst[i * 4 + 0] = clamp_q6(yy + 90 * vv);
+        dst[i * 4 + 1] = clamp_q6(yy - 22 * uu - 46 * vv);
+        dst[i * 4 + 2] = clamp_q6(yy + 113 * uu);
+        dst[i * 4 + 3] = 255;
+    }
+}
+
+void yuv420_to_rgba(uint8_t * dst, int dst_w, int dst_h, const YuvPlanes & src, int rotation) {
+    const bool transpose = rotation == 90 || rotation == 270;
+    const int  rot_w = transpose ? src.height : src.width;
+    const int  rot_h = transpose ? src.width  : src.height;
+
+    // Source coordinate along each axis of the rotated image, sampled at output pixel centres.
+    // For 90/270 an output column walks a source column, so the roles of the tables swap.
+    auto sample = [](int i, int n_out, int n_in) {
+        return (int) ((2 * i + 1) * (int64_t) n_in / (2 * n_out));
+    };
+    const bool flip_x = rotation == 90  || rotation == 180;
+    const bool flip_y = rotation == 180 || rotation == 270;
+
+    std::vector<int> y_col(dst_w), uv_col(dst_w);
+    for (int x = 0; x < dst_w; x++) {
+        int s = sample(x, dst_w, rot_w);
+        if (flip_x) {
+            s = rot_w - 1 - s;
+        }
+        y_col[x]  = transpose ? s * src.y_row_stride : s;
+        uv_col[x] = transpose ? (s / 2) * src.uv_row_stride : (s / 2) * src.uv_pixel_stride;
+    }
+
+    // Unrotated at full width, a luma row is already contiguous and goes in as it is
+    const bool direct_y = rotation == 0 && dst_w == src.width;
+
+    std::vector<uint8_t> y_row(dst_w), u_row(dst_w), v_row(dst_w);
+    for (int y = 0; y < dst_h; y++) {
+        int s = sample(y, dst_h, rot_h);
+        if (flip_y) {
+            s = rot_h - 1 - s;
+        }
+        const uint8_t * yp = src.y + (transpose ? s : (ptrdiff_t) s * src.y_row_stride);
+        const ptrdiff_t uv_off = transpose ? (s / 2) * src.uv_pixel_stride : (ptrdiff_t) (s / 2) * src.uv_row_stride;
+        const uint8_t * up = src.u + uv_off;
+        const uint8_t * vp = src.v + uv_off;
+
+        if (!direct_y) {
+            for (int x = 0; x < dst_w; x++) {
+                y_row[x] = yp[y_col[x]];
+            }
+        }
+        for (int x = 0; x < dst_w; x++) {
+            u_row[x] = up[uv_col[x]];
+            v_row[x] = vp[uv_col[x]];
+        }
+        yuv_row_to_rgba(dst + (size_t) y * dst_w * 4, direct_y ? yp : y_row.data(),
+                        u_row.data(), v_row.data(), dst_w);
+    }
+}
+
+void rotate_rgba(uint8_t * dst, const uint8_t * src, int width, int height, size_t src_stride,
+                 int rotation) {
+    const bool transpose = rotation == 90 || rotation == 270;
+    const int  dst_w = transpose ? height : width;
+    auto * out = reinterpret_cast<uint32_t *>(dst);
+
+    // Walk the source in order and scatter whole pixels to where the rotation puts them
+    for (int sy = 0; sy < height; sy++) {
+        const auto * row = reinterpret_cast<const uint32_t *>(src + sy * src_stride);
+        for (int sx = 0; sx < width; sx++) {
+            int x, y;
+            switch (rotation) {
+                case 90:  x = height - 1 - sy; y = sx;              break;
+                case 180: x = width - 1 - sx;  y = height - 1 - sy; break;
+                case 270: x = sy;              y = width - 1 - sx;  break;
+                default:  x = sx;              y = sy;              break;
+            }
+            out[(size_t) y * dst_w + x] = row[sx];
+        }
+    }
+}
+
+int jpeg_exif_orientation(const uint8_t * data, size_t size) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return 0;
+    }
+
+    // Walk the marker segments up to the scan data looking for APP1 "Exif\0\0"
+    size_t pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xFF) {
+        const uint8_t marker = data[pos + 1];
+        const size_t  len    = ((size_t) data[pos + 2] << 8) | data[pos + 3];
+        if (marker == 0xDA || len < 2 || pos + 2 + len > size) {
+            break;
+        }
+        const uint8_t * seg = data + pos + 4;
+        const size_t    n   = len - 2;
+        if (marker == 0xE1 && n >= 14 && memcmp(seg, "Exif\0\0", 6) == 0) {
+            const uint8_t * tiff = seg + 6;
+            const size_t    n_tiff = n - 6;
+            const bool le = tiff[0] == 'I';
+            auto u16 = [&](size_t o) -> uint32_t {
+                return le ? tiff[o] | (tiff[o + 1] << 8) : (tiff[o] << 8) | tiff[o + 1];
+            };
+            auto u32 = [&](size_t o) -> uint32_t {
+                return le ? u16(o) | (u16(o + 2) << 16) : (u16(o) << 16) | u16(o + 2);
+            };
+
+            const size_t ifd = u32(4);
+            if (ifd + 2 > n_tiff) {
+                return 0;
+            }
+            const uint32_t n_entries = u16(ifd);
+            for (uint32_t i = 0; i < n_entries && ifd + 2 + (i + 1) * 12 <= n_tiff; i++) {
+                const size_t e = ifd + 2 + i * 12;
+                if (u16(e) == 0x0112) {
+                    const uint32_t v = u16(e + 8);
+                    return v >= 1 && v <= 8 ? (int) v : 0;
+                }
+            }
+            return 0;
+        }
+        pos += 2 + len;
+    }
+    return 0;
+}
+
+void resize_rgb(uint8_t * dst, int dst_w, int dst_h, const uint8_t * src, int src_w, int src_h) {
+    // Source position of each output column in 8-bit fixed point: left index and weight
+    std::vector<int> x0(dst_w), x1(dst_w), fx(dst_w);
+    for (int x = 0; x < dst_w; x++) {
+        const int p = (int) (((2 * x + 1) * (int64_t) src_w * 256) / (2 * dst_w)) - 128;
+        const int i = std::max(0, p) >> 8;
+        x0[x] = i * 3;
+        x1[x] = std::min(i + 1, src_w - 1) * 3;
+        fx[x] = p < 0 ? 0 : p & 255;
+    }
+
+    for (int y = 0; y < dst_h; y++) {
+        const int p  = (int) (((2 * y + 1) * (int64_t) src_h * 256) / (2 * dst_h)) - 128;
+        const int i  = std::max(0, p) >> 8;
+        const int fy = p < 0 ? 0 : p & 255;
+        const uint8_t * r0 = src + (size_t) i * src_w * 3;
+        const uint8_t * r1 = src + (size_t) std::min(i + 1, src_h - 1) * src_w * 3;
+        uint8_t * out = dst + (size_t) y * dst_w * 3;
+
+        for (int x = 0; x < dst_w; x++) {
+            for (int c = 0; c < 3; c++) {
+                const int top = r0[x0[x] + c] * (256 - fx[x]) + r0[x1[x] + c] * fx[x];
+                const int bot = r1[x0[x] + c] * (256 - fx[x]) + r1[x1[x] + c] * fx[x];
+                out[x * 3 + c] = (uint8_t) ((top * (256 - fy) + bot * fy + (1 << 15)) >> 16);
+            }
+        }
+    }
+}
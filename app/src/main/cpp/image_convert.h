@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Pack RGBA_8888 pixels into RGB by dropping alpha. `dst` may equal `src` to convert in place.
+void rgba_to_rgb(uint8_t * dst, const uint8_t * src, size_t n_pixels);
+
+// One YUV_420_888 camera image as CameraX hands it over: a full-resolution luma plane
+// (pixel stride 1) and two half-resolution chroma planes, planar or interleaved.
+struct YuvPlanes {
+    const uint8_t * y;
+    const uint8_t * u;
+    const uint8_t * v;
+    int y_row_stride;
+    int uv_row_stride;
+    int uv_pixel_stride;
+    int width;
+    int height;
+};
+
+// Rotate `src` clockwise by `rotation` degrees (0/90/180/270), resample it to dst_w x dst_h and
+// convert to RGBA_8888, all in one pass over the output pixels. Sampling is nearest-neighbour.
+void yuv420_to_rgba(uint8_t * dst, int dst_w, int dst_h, const YuvPlanes & src, int rotation);
+
+// Rotate a `width` x `height` RGBA_8888 image clockwise by `rotation` degrees (0/90/180/270).
+// `src_stride` is the source row pitch in bytes; `dst` is written tightly packed.
+void rotate_rgba(uint8_t * dst, const uint8_t * src, int width, int height, size_t src_stride,
+                 int rotation);
+
+// EXIF orientation tag (1-8) of a JPEG, or 0 when it carries none
+int jpeg_exif_orientation(const uint8_t * data, size_t size);
+
+// Bilinear resize of packed RGB, sampling at pixel centres. Meant for the last, small step to
+// an encoder's exact input size; `dst` must not overlap `src`.
+void resize_rgb(uint8_t * dst, int dst_w, int dst_h, const uint8_t * src, int src_w, int src_h);
@@ -0,0 +1,134 @@
+#include "keyframes.h"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr int   SAMPLES      = 64;     // lattice points per side at most
+static constexpr float KEYFRAME_TIE = 0.1f;   // relative distance within which candidates tie
+
+void frame_signature(FrameSignature & sig, const uint8_t * rgba, int width, int height, size_t stride) {
+    constexpr int GRID = FrameSignature::GRID;
+    std::fill(std::begin(sig.hist), std::end(sig.hist), 0.0f);
+    std::fill(std::begin(sig.grid), std::end(sig.grid), 0.0f);
+
+    const int step_x = std::max(1, width  / SAMPLES);
+    const int step_y = std::max(1, height / SAMPLES);
+    int cell_count[GRID * GRID] = {};
+    int n = 0;
+
+    for (int y = step_y / 2; y < height; y += step_y) {
+        const uint8_t * row = rgba + (size_t) y * stride;
+        const int cy = y * GRID / height;
+        for (int x = step_x / 2; x < width; x += step_x) {
+            const uint8_t * p = row + (size_t) x * 4;
+            sig.hist[(p[0] >> 6) * 16 + (p[1] >> 6) * 4 + (p[2] >> 6)] += 1.0f;
+
+            // BT.601 luma in Q8
+            const int cell = cy * GRID + x * GRID / width;
+            sig.grid[cell] += (float) ((77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8);
+            cell_count[cell]++;
+            n++;
+        }
+    }
+
+    const float inv_n = n > 0 ? 1.0f / n : 0.0f;
+    for (float & h : sig.hist) {
+        h *= inv_n;
+    }
+    for (int i = 0; i < GRID * GRID; i++) {
+        sig.grid[i] = cell_count[i] > 0 ? sig.grid[i] / (255.0f * cell_count[i]) : 0.0f;
+    }
+}
+
+uint64_t frame_dhash(const uint8_t * rgba, int width, int height, size_t stride) {
+    constexpr int COLS = 9, ROWS = 8;
+    uint32_t sum[ROWS][COLS] = {};
+    uint32_t count[ROWS][COLS] = {};
+
+    const int step_x = std::max(1, width  / SAMPLES);
+    const int step_y = std::max(1, height / SAMPLES);
+    for (int y = step_y / 2; y < height; y += step_y) {
+        const uint8_t * row = rgba + (size_t) y * stride;
+        const int cy = y * ROWS / height;
+        for (int x = step_x / 2; x < width; x += step_x) {
+            const uint8_t * p = row + (size_t) x * 4;
+            const int cx = x * COLS / width;
+            sum[cy][cx] += (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+            count[cy][cx]++;
+        }
+    }
+
+    // Compare cell means without dividing: a/n < b/m  <=>  a*m < b*n
+    uint64_t hash = 0;
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS - 1; c++) {
+            const uint64_t left  = (uint64_t) sum[r][c]     * count[r][c + 1];
+            const uint64_t right = (uint64_t) sum[r][c + 1] * count[r][c];
+            hash = (hash << 1) | (left < right ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+float frame_distance(const FrameSignature & a, const FrameSignature & b) {
+    constexpr int N_GRID = FrameSignature::GRID * FrameSignature::GRID;
+
+    // Half the L1 distance of two normalised histograms is their non-overlapping mass
+    float hist = 0.0f;
+    for (int i = 0; i < FrameSignature::HIST_BINS; i++) {
+        hist += std::fabs(a.hist[i] - b.hist[i]);
+    }
+    float grid = 0.0f;
+    for (int i = 0; i < N_GRID; i++) {
+        grid += std::fabs(a.grid[i] - b.grid[i]);
+    }
+    return 0.5f * (0.5f * hist) + 0.5f * (grid / N_GRID);
+}
+
+std::vector<size_t> select_keyframes(const std::vector<FrameSignature> & sigs, size_t k, float min_change) {
+    std::vector<size_t> picks;
+    const size_t n = sigs.size();
+    if (n == 0 || k == 0) {
+        return picks;
+    }
+
+    // Farthest-point selection: start from the first frame, then keep adding the frame least
+    // like any keyframe so far. nearest[i] is frame i's distance to its closest keyframe.
+    std::vector<float> nearest(n);
+    picks.push_back(0);
+    for (size_t i = 0; i < n; i++) {
+        nearest[i] = frame_distance(sigs[0], sigs[i]);
+    }
+
+    while (picks.size() < k) {
+        const float farthest = *std::max_element(nearest.begin(), nearest.end());
+        if (farthest < min_change) {
+            break;  // everything left is a near-duplicate of a keyframe
+        }
+
+        // Frames about as different as the farthest one tie (an object moving across a still
+        // background is equally far from the first frame all along its path); of those take
+        // the one farthest in time from every keyframe, so the motion is sampled evenly
+        size_t far = n, far_gap = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (nearest[i] < farthest * (1.0f - KEYFRAME_TIE)) {
+                continue;
+            }
+            size_t gap = n;
+            for (size_t p : picks) {
+                gap = std::min(gap, i > p ? i - p : p - i);
+            }
+            if (far == n || gap > far_gap) {
+                far     = i;
+                far_gap = gap;
+            }
+        }
+        picks.push_back(far);
+        for (size_t i = 0; i < n; i++) {
+            nearest[i] = std::min(nearest[i], frame_distance(sigs[far], sigs[i]));
+        }
+    }
+
+    std::sort(picks.begin(), picks.end());
+    return picks;
+}
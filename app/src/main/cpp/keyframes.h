@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact appearance of one frame: a joint RGB colour histogram and a coarse luma grid, so
+// both a change of content and the motion of similarly coloured content register.
+struct FrameSignature {
+    static constexpr int HIST_BINS = 64;    // 4 levels per channel
+    static constexpr int GRID      = 8;     // GRID x GRID luma thumbnail
+    float hist[HIST_BINS];
+    float grid[GRID * GRID];
+};
+
+// Signature of a `width` x `height` RGBA_8888 frame with a row pitch of `stride` bytes.
+// Reads a subsampled lattice of at most ~64x64 pixels, so the cost is independent of size.
+void frame_signature(FrameSignature & sig, const uint8_t * rgba, int width, int height, size_t stride);
+
+// 64-bit difference hash (dHash) of a `width` x `height` RGBA_8888 frame with a row pitch of
+// `stride` bytes: the luma of a 9x8 box-filtered thumbnail, one bit per horizontally adjacent
+// pair that gets brighter. Near-identical frames differ in few bits (compare with popcount).
+uint64_t frame_dhash(const uint8_t * rgba, int width, int height, size_t stride);
+
+// Difference between two frames in [0, 1]: histogram and grid distances, equally weighted
+float frame_distance(const FrameSignature & a, const FrameSignature & b);
+
+// Pick up to `k` keyframes of a clip, returned as ascending indices into `sigs`. Starting from
+// the first frame, each next keyframe is the frame farthest from every keyframe so far (near
+// ties go to the one farthest in time from them), so each scene and each stage of an action
+// gets a frame before any of them gets a second. Selection stops early once no frame is
+// `min_change` away from a keyframe: a static clip yields one.
+std::vector<size_t> select_keyframes(const std::vector<FrameSignature> & sigs, size_t k, float min_change);
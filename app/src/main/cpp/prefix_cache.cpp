@@ -0,0 +1,143 @@
+#include "prefix_cache.h"
+
+#include <algorithm>
+
+// Length of the common prefix of `edge` and key[i..]
+static size_t match_edge(const PrefixCache::Key & edge, const PrefixCache::Key & key, size_t i) {
+    size_t m = 0;
+    while (m < edge.size() && i + m < key.size() && edge[m] == key[i + m]) {
+        m++;
+    }
+    return m;
+}
+
+PrefixCache::Match PrefixCache::lookup(const Key & key, size_t min_items, size_t max_items) {
+    Node * node = &root;   // deepest node whose whole path matches
+    Node * tail = nullptr; // child whose edge only partly matches
+    size_t i = 0;
+    while (i < key.size()) {
+        auto it = node->children.find(key[i]);
+        if (it == node->children.end()) {
+            break;
+        }
+        Node * child = it->second.get();
+        const size_t m = match_edge(child->edge, key, i);
+        i += m;
+        if (m < child->edge.size()) {
+            tail = child;
+            break;
+        }
+        node = child;
+    }
+
+    // Every state below the match point starts with the matched items
+    Match match;
+    match.n_items = std::min(i, max_items);
+    Node * best = most_recent_in(tail ? tail : node);
+    if (!best || match.n_items == 0 || match.n_items < min_items) {
+        n_misses++;
+        return {};
+    }
+
+    best->last_used = ++clock;
+    match.state = &best->state;
+    match.exact = !tail && i == key.size() && node->has_state;
+    n_hits++;
+    return match;
+}
+
+void PrefixCache::insert(const Key & key, State && state) {
+    if (key.empty() || state.size() > budget) {
+        return;
+    }
+
+    Node * node = &root;
+    size_t i = 0;
+    while (i < key.size()) {
+        auto it = node->children.find(key[i]);
+        if (it == node->children.end()) {
+            auto leaf = std::make_unique<Node>();
+            leaf->edge.assign(key.begin() + i, key.end());
+            leaf->parent = node;
+            node = (node->children[key[i]] = std::move(leaf)).get();
+            break;
+        }
+
+        const size_t m = match_edge(it->second->edge, key, i);
+        if (m < it->second->edge.size()) {
+            // Split the edge so the shared part ends on a node
+            auto mid = std::make_unique<Node>();
+            mid->edge.assign(it->second->edge.begin(), it->second->edge.begin() + m);
+            mid->parent = node;
+
+            std::unique_ptr<Node> rest = std::move(it->second);
+            rest->edge.erase(rest->edge.begin(), rest->edge.begin() + m);
+            rest->parent = mid.get();
+            mid->children[rest->edge[0]] = std::move(rest);
+            it->second = std::move(mid);
+        }
+        node = it->second.get();
+        i += m;
+    }
+
+    if (node->has_state) {
+        n_bytes -= node->state.size();
+    }
+    n_bytes += state.size();
+    node->state     = std::move(state);
+    node->has_state = true;
+    node->last_used = ++clock;
+
+    while (n_bytes > budget) {
+        Node * victim = least_recent_in(&root);
+        if (!victim || victim == node) {
+            break;
+        }
+        drop_state(victim);
+    }
+}
+
+PrefixCache::Node * PrefixCache::most_recent_in(Node * node) {
+    Node * best = node->has_state ? node : nullptr;
+    for (auto & [_, child] : node->children) {
+        Node * cand = most_recent_in(child.get());
+        if (cand && (!best || cand->last_used > best->last_used)) {
+            best = cand;
+        }
+    }
+    return best;
+}
+
+PrefixCache::Node * PrefixCache::least_recent_in(Node * node) {
+    Node * best = node->has_state ? node : nullptr;
+    for (auto & [_, child] : node->children) {
+        Node * cand = least_recent_in(child.get());
+        if (cand && (!best || cand->last_used < best->last_used)) {
+            best = cand;
+        }
+    }
+    return best;
+}
+
+void PrefixCache::drop_state(Node * node) {
+    n_bytes -= node->state.size();
+    State().swap(node->state);
+    node->has_state = false;
+
+    // Remove branches that no longer lead to any state
+    while (node != &root && !node->has_state && node->children.empty()) {
+        Node * parent = node->parent;
+        parent->children.erase(node->edge[0]);
+        node = parent;
+    }
+
+    // Fold a stateless pass-through node into its only child to keep the tree compressed
+    if (node != &root && !node->has_state && node->children.size() == 1) {
+        Node * parent = node->parent;
+        const uint64_t first = node->edge[0];
+        std::unique_ptr<Node> child = std::move(node->children.begin()->second);
+        child->edge.insert(child->edge.begin(), node->edge.begin(), node->edge.end());
+        child->parent = parent;
+        parent->children[first] = std::move(child); // frees `node`
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Radix tree over prompt keys (text token ids and image content hashes) whose nodes hold
+// serialized KV sequence states. A request restores the state that shares the longest prefix
+// with it and only evaluates the rest. States are evicted LRU-first past a byte budget.
+class PrefixCache {
+public:
+    using Key   = std::vector<uint64_t>;
+    using State = std::vector<uint8_t>;
+
+    struct Match {
+        size_t        n_items = 0;       // leading key items covered by `state`
+        const State * state   = nullptr; // may cover more than n_items, the caller truncates it
+        bool          exact   = false;   // the full key already has a state of its own
+    };
+
+    explicit PrefixCache(size_t budget_bytes) : budget(budget_bytes) {}
+
+    // Longest cached prefix of `key`, capped at `max_items`. Matches shorter than `min_items`
+    // are reported (and counted) as misses.
+    Match lookup(const Key & key, size_t min_items, size_t max_items);
+
+    // Store the state reached after evaluating all of `key`, evicting old entries to fit
+    void insert(const Key & key, State && state);
+
+    size_t hits()   const { return n_hits; }
+    size_t misses() const { return n_misses; }
+    size_t bytes()  const { return n_bytes; }
+
+private:
+    struct Node {
+        Key edge; // items between the parent and this node
+        Node * parent = nullptr;
+        std::map<uint64_t, std::unique_ptr<Node>> children;
+
+        State    state;
+        bool     has_state = false;
+        uint64_t last_used = 0;
+    };
+
+    Node * most_recent_in(Node * node);
+    Node * least_recent_in(Node * node);
+    void   drop_state(Node * node);
+
+    Node     root;
+    size_t   budget;
+    size_t   n_bytes  = 0;
+    size_t   n_hits   = 0;
+    size_t   n_misses = 0;
+    uint64_t clock    = 0;
+};
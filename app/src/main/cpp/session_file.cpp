@@ -0,0 +1,129 @@
+#include "session_file.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static bool write_raw(FILE * f, const void * data, size_t size) {
+    return size == 0 || fwrite(data, 1, size, f) == size;
+}
+
+template <typename T>
+static bool write_pod(FILE * f, const T & value) {
+    return write_raw(f, &value, sizeof(T));
+}
+
+template <typename T>
+static bool write_vector(FILE * f, const std::vector<T> & v) {
+    return write_pod(f, (uint64_t) v.size()) && write_raw(f, v.data(), v.size() * sizeof(T));
+}
+
+static bool write_string(FILE * f, const std::string & str) {
+    return write_pod(f, (uint64_t) str.size()) && write_raw(f, str.data(), str.size());
+}
+
+static bool read_raw(FILE * f, void * data, size_t size) {
+    return size == 0 || fread(data, 1, size, f) == size;
+}
+
+template <typename T>
+static bool read_pod(FILE * f, T & value) {
+    return read_raw(f, &value, sizeof(T));
+}
+
+// `max_bytes` bounds the allocation so a corrupt length can't exhaust memory
+template <typename T>
+static bool read_vector(FILE * f, std::vector<T> & v, size_t max_bytes) {
+    uint64_t n = 0;
+    if (!read_pod(f, n) || n > max_bytes / sizeof(T)) {
+        return false;
+    }
+    v.resize(n);
+    return read_raw(f, v.data(), n * sizeof(T));
+}
+
+static bool read_string(FILE * f, std::string & str, size_t max_bytes) {
+    uint64_t n = 0;
+    if (!read_pod(f, n) || n > max_bytes) {
+        return false;
+    }
+    str.resize(n);
+    return read_raw(f, str.data(), n);
+}
+
+bool write_session_file(const std::string & path, const SessionFile & session) {
+    const std::string tmp_path = path + ".tmp";
+    FILE * f = fopen(tmp_path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = write_pod(f, SESSION_MAGIC) && write_pod(f, SESSION_VERSION) &&
+              write_vector(f, session.image_hashes) &&
+              write_pod(f, session.seed) && write_pod(f, session.n_past) &&
+              write_vector(f, session.recent) &&
+              write_vector(f, session.turn_start) &&
+              write_pod(f, session.max_turns) && write_pod(f, session.max_reply) &&
+              write_pod(f, (uint64_t) session.messages.size());
+    for (const auto & [role, content] : session.messages) {
+        ok = ok && write_string(f, role) && write_string(f, content);
+    }
+    ok = ok && write_vector(f, session.state);
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+SessionReadStatus read_session_file(const std::string & path, SessionFile & session, uint32_t & version) {
+    FILE * f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return SessionReadStatus::MISSING;
+    }
+    fseek(f, 0, SEEK_END);
+    const size_t file_size = (size_t) ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint32_t magic = 0;
+    version = 0;
+    if (!read_pod(f, magic) || magic != SESSION_MAGIC || !read_pod(f, version)) {
+        fclose(f);
+        return SessionReadStatus::INVALID;
+    }
+    if (version != SESSION_VERSION) {
+        fclose(f);
+        return SessionReadStatus::WRONG_VERSION;
+    }
+
+    SessionFile s;
+    uint64_t n_messages = 0;
+    bool ok = read_vector(f, s.image_hashes, file_size) && !s.image_hashes.empty() &&
+              read_pod(f, s.seed) && read_pod(f, s.n_past) && s.n_past >= 0 &&
+              read_vector(f, s.recent, file_size) &&
+              read_vector(f, s.turn_start, file_size) &&
+              read_pod(f, s.max_turns) && read_pod(f, s.max_reply) && s.max_reply > 0 &&
+              read_pod(f, n_messages) && n_messages <= file_size;
+    for (uint64_t i = 0; ok && i < n_messages; i++) {
+        std::pair<std::string, std::string> msg;
+        ok = read_string(f, msg.first, file_size) && read_string(f, msg.second, file_size);
+        s.messages.push_back(std::move(msg));
+    }
+    ok = ok && read_vector(f, s.state, file_size) && !s.state.empty();
+    // Anything after the state means the file is not what this version writes
+    ok = ok && fgetc(f) == EOF;
+    fclose(f);
+
+    // A session ends on a reply, and turn starts ascend inside the sequence, at most one per
+    // (user, assistant) pair
+    ok = ok && !s.messages.empty() && s.messages.back().first == "assistant" &&
+         s.turn_start.size() <= s.messages.size() / 2 &&
+         std::is_sorted(s.turn_start.begin(), s.turn_start.end()) &&
+         (s.turn_start.empty() || (s.turn_start.front() >= 0 && s.turn_start.back() < s.n_past));
+    if (!ok) {
+        return SessionReadStatus::INVALID;
+    }
+    session = std::move(s);
+    return SessionReadStatus::OK;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Session file: header, sampler inputs, sliding window, messages, then the KV sequence from
+// llama_state_seq_get_data. Version 2 added the sliding window; older files are rejected.
+static constexpr uint32_t SESSION_MAGIC   = 0x53455356; // "VSES"
+static constexpr uint32_t SESSION_VERSION = 2;
+
+// Everything a saved chat session holds. Positions and tokens are llama_pos and llama_token,
+// both int32_t; the KV state is an opaque blob, so this builds without llama.cpp.
+struct SessionFile {
+    std::vector<uint64_t> image_hashes; // the first one is the image the session was saved for
+    uint32_t seed   = 0;
+    int32_t  n_past = 0;
+    std::vector<int32_t> recent;
+    std::vector<int32_t> turn_start;
+    uint64_t max_turns = 0;
+    int32_t  max_reply = 0;
+    std::vector<std::pair<std::string, std::string>> messages;
+    std::vector<uint8_t> state;
+};
+
+enum class SessionReadStatus {
+    OK,
+    MISSING,       // cannot be opened
+    WRONG_VERSION, // a session file of another version
+    INVALID,       // truncated, corrupt or inconsistent
+};
+
+// Write through a temporary file next to `path` and rename, so a crash never leaves a
+// truncated session behind
+bool write_session_file(const std::string & path, const SessionFile & session);
+
+// Read and validate a whole file. `session` is only assigned when the result is OK; `version`
+// receives the file's version once the magic matched.
+SessionReadStatus read_session_file(const std::string & path, SessionFile & session, uint32_t & version);
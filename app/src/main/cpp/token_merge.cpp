@@ -0,0 +1,89 @@
+#include "token_merge.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+// One round: merge up to `r` tokens of the even set into their best odd partners
+static size_t merge_round(float * embd, std::vector<float> & size, size_t n, size_t n_embd, size_t r) {
+    // Unit-length copies for cosine similarity
+    std::vector<float> unit(embd, embd + n * n_embd);
+    for (size_t i = 0; i < n; i++) {
+        float * row = &unit[i * n_embd];
+        float norm = 0.0f;
+        for (size_t k = 0; k < n_embd; k++) {
+            norm += row[k] * row[k];
+        }
+        const float inv = norm > 0.0f ? 1.0f / std::sqrt(norm) : 0.0f;
+        for (size_t k = 0; k < n_embd; k++) {
+            row[k] *= inv;
+        }
+    }
+
+    const size_t n_a = (n + 1) / 2;
+    std::vector<size_t> best(n_a);
+    std::vector<float>  score(n_a, -2.0f);
+    for (size_t a = 0; a < n_a; a++) {
+        const float * ra = &unit[(2 * a) * n_embd];
+        for (size_t b = 1; b < n; b += 2) {
+            const float * rb = &unit[b * n_embd];
+            float dot = 0.0f;
+            for (size_t k = 0; k < n_embd; k++) {
+                dot += ra[k] * rb[k];
+            }
+            if (dot > score[a]) {
+                score[a] = dot;
+                best[a]  = b;
+            }
+        }
+    }
+
+    // The r even tokens closest to a partner are folded into it, weighted by how many
+    // original tokens each side already stands for
+    std::vector<size_t> order(n_a);
+    std::iota(order.begin(), order.end(), 0);
+    r = std::min(r, n / 2);
+    std::partial_sort(order.begin(), order.begin() + r, order.end(),
+                      [&](size_t x, size_t y) { return score[x] > score[y]; });
+
+    std::vector<bool> merged(n, false);
+    for (size_t j = 0; j < r; j++) {
+        const size_t a = 2 * order[j];
+        const size_t b = best[order[j]];
+        const float  wa = size[a], wb = size[b];
+        float * dst = &embd[b * n_embd];
+        const float * src = &embd[a * n_embd];
+        for (size_t k = 0; k < n_embd; k++) {
+            dst[k] = (dst[k] * wb + src[k] * wa) / (wa + wb);
+        }
+        size[b] += wa;
+        merged[a] = true;
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (merged[i]) {
+            continue;
+        }
+        if (out != i) {
+            memcpy(&embd[out * n_embd], &embd[i * n_embd], n_embd * sizeof(float));
+            size[out] = size[i];
+        }
+        out++;
+    }
+    return out;
+}
+
+size_t merge_tokens(float * embd, size_t n_tokens, size_t n_embd, size_t n_keep) {
+    n_keep = std::max<size_t>(n_keep, 1);
+    std::vector<float> size(n_tokens, 1.0f);
+    // At most a quarter per round: a round that takes all of the even set would merge its
+    // most distinct tokens too, however little they resemble their partners
+    while (n_tokens > n_keep && n_tokens > 1) {
+        const size_t r = std::min(n_tokens - n_keep, std::max<size_t>(1, n_tokens / 4));
+        n_tokens = merge_round(embd, size, n_tokens, n_embd, r);
+    }
+    return n_tokens;
+}
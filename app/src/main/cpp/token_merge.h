@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+// Reduce `n_tokens` rows of `n_embd` floats in `embd` to `n_keep` by bipartite soft matching
+// (ToMe): tokens alternate between two sets, each token of the first set finds its most
+// cosine-similar partner in the second, and the most redundant pairs are averaged into one.
+// Rounds repeat until `n_keep` remain. Survivors keep their original order; the result is
+// compacted to the front of `embd`. Returns the number of rows left.
+size_t merge_tokens(float * embd, size_t n_tokens, size_t n_embd, size_t n_keep);
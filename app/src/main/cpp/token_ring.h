@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Single-producer/single-consumer ring of UTF-8 token bytes, exposed to Kotlin as a direct
+// ByteBuffer. The generator pushes without ever calling into the JVM; the consumer thread
+// sleeps in wait_readable(), copies bytes out of the buffer and hands them back with consume().
+// Both sides count bytes monotonically and index the buffer modulo its capacity.
+class TokenRing {
+public:
+    explicit TokenRing(size_t capacity) : buf(capacity) {}
+
+    uint8_t * data()           { return buf.data(); }
+    size_t    capacity() const { return buf.size(); }
+
+    // Producer: append bytes. Only waits if the consumer is a whole ring behind, and drops the
+    // rest once the consumer has gone away.
+    void push(const char * bytes, size_t n) {
+        const size_t cap = buf.size();
+        while (n > 0) {
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            const size_t   n_free = cap - (size_t) (h - tail.load(std::memory_order_acquire));
+            if (n_free == 0) {
+                if (abandoned.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+
+            const size_t chunk = std::min(n, n_free);
+            const size_t pos   = (size_t) (h % cap);
+            const size_t first = std::min(chunk, cap - pos);
+            memcpy(&buf[pos], bytes, first);
+            memcpy(&buf[0], bytes + first, chunk - first);
+            head.store(h + chunk, std::memory_order_seq_cst);
+            wake();
+
+            bytes += chunk;
+            n     -= chunk;
+        }
+    }
+
+    // Producer is done; the consumer drains what is left and then sees the end
+    void close() {
+        closed.store(true, std::memory_order_seq_cst);
+        wake();
+    }
+
+    // Consumer stopped reading, so a full ring must not hold the producer back
+    void abandon() {
+        abandoned.store(true, std::memory_order_relaxed);
+    }
+
+    // Consumer: bytes readable past what it consumed so far, 0 on timeout, -1 once closed and drained
+    int64_t wait_readable(int timeout_ms) {
+        std::unique_lock<std::mutex> lock(mtx);
+        waiting.store(true, std::memory_order_seq_cst);
+        cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] {
+            return readable() > 0 || closed.load(std::memory_order_seq_cst);
+        });
+        waiting.store(false, std::memory_order_relaxed);
+
+        const uint64_t n = readable();
+        if (n == 0 && closed.load(std::memory_order_seq_cst)) {
+            return -1;
+        }
+        return (int64_t) n;
+    }
+
+    void consume(size_t n) {
+        tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+private:
+    uint64_t readable() const {
+        return head.load(std::memory_order_seq_cst) - tail.load(std::memory_order_relaxed);
+    }
+
+    // Only touch the mutex when the consumer is (about to be) asleep; seq_cst on `head` and
+    // `waiting` guarantees one side sees the other, so no wake-up is lost
+    void wake() {
+        if (waiting.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_one();
+        }
+    }
+
+    std::vector<uint8_t> buf;
+    std::atomic<uint64_t> head{ 0 };   // written by the producer
+    std::atomic<uint64_t> tail{ 0 };   // written by the consumer
+    std::atomic<bool> closed{ false };
+    std::atomic<bool> abandoned{ false };
+    std::atomic<bool> waiting{ false };
+
+    std::mutex mtx;
+    std::condition_variable cv;
+};
@@ -1,14 +1,36 @@
 #include <jni.h>
 #include <android/log.h>
+#include <android/bitmap.h>
+#include <android/imagedecoder.h>
 #include <string>
 #include <vector>
+#include <memory>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
 
 #include "llama.h"
 #include "ggml.h"
 #include "ggml-backend.h"
 #include "mtmd.h"
 #include "mtmd-helper.h"
+#include "gguf.h"
+
+#include "image_convert.h"
+#include "keyframes.h"
+#include "prefix_cache.h"
+#include "session_file.h"
+#include "token_merge.h"
+#include "token_ring.h"
 
 using steady_clock = std::chrono::steady_clock;
 
@@ -17,6 +39,48 @@ using steady_clock = std::chrono::steady_clock;
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
 
 static constexpr int MAX_TOKENS = 400;
+static constexpr int N_BATCH    = 128;
+static constexpr int PENALTY_LAST_N = 64;
+
+// Long-video mode: reply length of a segment caption or a folded summary, and how many entries
+// of one level are folded into a single entry of the level above
+static constexpr int    LONG_VIDEO_CAPTION_TOKENS = 64;
+static constexpr size_t LONG_VIDEO_GROUP          = 6;
+
+// Cores kept out of the vision encoder's thread pool for the thread that resamples the next
+// video frame while the current one is encoded
+static constexpr int ENCODE_HELPER_THREADS = 1;
+
+// Smallest appearance change (frame_distance) that makes a video frame worth encoding
+static constexpr float KEYFRAME_MIN_CHANGE = 0.015f;
+
+// Cosine distance between pooled encoder outputs below which a frame shows the same scene
+static constexpr float CHANGE_GATE_THRESHOLD = 0.03f;
+
+// Continuous pipeline scheduling
+static constexpr int    CONTINUOUS_POLL_MS          = 50;    // how often a blocked wait re-checks
+static constexpr float  CONTINUOUS_EMA              = 0.3f;  // weight of a new timing sample
+static constexpr float  CONTINUOUS_DOWNGRADE_GUESS  = 0.8f;  // describe time at half the tokens, until measured
+static constexpr size_t CONTINUOUS_DOWNGRADE_TOKENS = 64;    // token cap of a downgraded frame without one
+static constexpr size_t CONTINUOUS_LATENCY_SAMPLES  = 256;
+
+// Host memory for saved KV states of earlier prompts
+static constexpr size_t PREFIX_CACHE_BYTES = 64u << 20;
+
+// KV cache sequences: one-shot requests run on SEQ_ONESHOT, SEQ_SYSTEM holds the prefilled
+// system prompt, chat sessions get one of the rest
+static constexpr int          N_SEQ       = 4;
+static constexpr llama_seq_id SEQ_ONESHOT = 0;
+static constexpr llama_seq_id SEQ_SYSTEM  = N_SEQ - 1;
+
+// Cancellation flag of one JNI call. cancelRequest may set it from any thread; the decode
+// loops and ggml's abort callback poll it. Streaming calls also carry the ring their tokens
+// go through instead of a JNI callback per token.
+struct Request {
+    std::atomic<bool> cancelled{ false };
+    std::unique_ptr<TokenRing> ring;
+    size_t n_visual_tokens = 0; // of the images the call prefilled or encoded, read back once it returns
+};
 
 struct VisionAIContext {
     llama_model   * model    = nullptr;
@@ -24,8 +88,129 @@ struct VisionAIContext {
     llama_sampler * sampler  = nullptr;
     mtmd_context  * ctx_mtmd = nullptr;
     int n_threads = 4;
+    bool seq_in_use[N_SEQ] = { true }; // SEQ_ONESHOT is always taken
+
+    // Templated text before the user content, already prefilled into SEQ_SYSTEM at load
+    std::string system_prefix;
+    std::vector<llama_token> system_tokens;
+
+    PrefixCache prefix_cache{ PREFIX_CACHE_BYTES };
+
+    // Vision encoder input geometry from the mmproj; 0 when the keys are missing
+    int encoder_image_size   = 0; // side of one encoder tile
+    int encoder_preproc_size = 0; // long side images are rescaled to before tiling, if it tiles
+
+    // Fraction of visual tokens kept per image chunk after merging; 1 disables the stage
+    std::atomic<float> token_keep_ratio{ 1.0f };
+
+    // Continuous-mode change gate: pooled encoder output of the last frame let through to the
+    // LLM, only touched by gateFrame calls. A reset request is picked up by the next call.
+    std::vector<float> gate_anchor;
+    std::atomic<bool>     gate_reset{ false };
+    std::atomic<float>    gate_threshold{ CHANGE_GATE_THRESHOLD };
+    std::atomic<uint32_t> gate_frames{ 0 };
+    std::atomic<uint32_t> gate_skipped{ 0 };
+    std::atomic<float>    gate_last_distance{ 0.0f };
+
+    // Held around every computation on the llama context: llama_decode, image chunk decodes
+    // and KV state copies. The vision encoder takes it too, but only when it runs on the same
+    // GPU as the LLM: a GPU backend keeps one queue and kernel set per device, which two
+    // threads must not feed at once. On CPU the continuous worker encodes while this decodes.
+    std::mutex compute_mtx;
+    bool encoder_shares_gpu = false;
+
+    std::atomic<Request *> active{ nullptr }; // request currently running on this context
+};
+
+// Makes a request the context's active one for the duration of a JNI call
+struct ActiveRequest {
+    VisionAIContext * vctx;
+
+    ActiveRequest(VisionAIContext * vctx, jlong request_ptr) : vctx(vctx) {
+        vctx->active = reinterpret_cast<Request *>(request_ptr);
+    }
+    ~ActiveRequest() {
+        Request * req = vctx->active.exchange(nullptr);
+        if (req && req->ring) {
+            req->ring->close();
+        }
+    }
+};
+
+static bool is_cancelled(const Request * req) {
+    return req && req->cancelled;
+}
+
+static bool is_cancelled(const VisionAIContext * vctx) {
+    return is_cancelled(vctx->active.load());
+}
+
+static int32_t decode_batch(VisionAIContext * vctx, const llama_batch & batch) {
+    std::lock_guard<std::mutex> lock(vctx->compute_mtx);
+    return llama_decode(vctx->ctx, batch);
+}
+
+// ggml abort callback: stops llama_decode between graph nodes once the request is cancelled
+static bool abort_requested(void * data) {
+    return is_cancelled(static_cast<const VisionAIContext *>(data));
+}
+
+// Where a generation draws tokens from and which KV sequence it appends them to
+struct GenerationState {
+    llama_sampler * sampler;
+    llama_seq_id    seq_id;
+    llama_pos       n_past;
+    std::vector<llama_token> generated = {};
+};
+
+// Multi-turn conversation that owns a KV sequence, its position and its sampler across turns,
+// so a follow-up only decodes the new question plus the assistant header
+struct ChatSession {
+    VisionAIContext * vctx    = nullptr;
+    llama_seq_id      seq_id  = -1;
+    llama_pos         n_past  = 0;
+    llama_sampler   * sampler = nullptr;
+    std::vector<std::pair<std::string, std::string>> messages; // (role, content), no system message
+
+    // Everything the sampler of the next turn is rebuilt from, so a session restored from disk
+    // samples exactly like the one that was saved
+    uint32_t seed = 0;
+    std::vector<llama_token> recent;      // last PENALTY_LAST_N reply tokens
+    std::vector<uint64_t> image_hashes;   // images of the first turn, the key of a saved session
+
+    // Sliding window: KV position where each (user, assistant) turn still held starts, and how
+    // many turns to keep (0 = all). A turn's range also covers the closing tokens of its reply.
+    std::vector<llama_pos> turn_start;
+    size_t max_turns  = 0;
+    int    max_reply  = MAX_TOKENS;           // reply tokens a turn may generate
+
+    // First turn being built frame by frame while a video records: the prompt, the templated
+    // text that follows the frames, and how many frames are already in the KV cache
+    bool        ingesting = false;
+    std::string frames_prompt;
+    std::string frames_suffix;
+    size_t      n_frames  = 0;
+    steady_clock::time_point frames_start;
 };
 
+// An image run through the vision encoder once. The projected embeddings are kept so
+// describe and Q&A calls on the same image can go straight to LLM prefill.
+struct ImageEmbedding {
+    mtmd_input_chunks * chunks = nullptr;   // tokenization of a lone media marker
+    std::vector<std::vector<float>> embd;   // encoder output per chunk (empty for text chunks)
+    size_t    n_tokens = 0;
+    llama_pos n_pos    = 0;                 // KV positions the image occupies
+    uint64_t  hash     = 0;                 // content hash of the source pixels, for the prefix cache
+
+    ~ImageEmbedding() {
+        if (chunks) mtmd_input_chunks_free(chunks);
+    }
+};
+
+static long long elapsed_ms(steady_clock::time_point a, steady_clock::time_point b) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
+}
+
 static void throw_java_exception(JNIEnv * env, const char * msg) {
     jclass cls = env->FindClass("java/lang/IllegalStateException");
     if (cls) {
@@ -33,631 +218,2877 @@ static void throw_java_exception(JNIEnv * env, const char * msg) {
     }
 }
 
+// Report a failure through TokenCallback.onError
+static void callback_error(JNIEnv * env, jobject callback, const char * msg) {
+    jclass cbClass = env->GetObjectClass(callback);
+    jmethodID onErrorMethod = env->GetMethodID(cbClass, "onError", "(Ljava/lang/String;)V");
+    jstring jerr = env->NewStringUTF(msg);
+    env->CallVoidMethod(callback, onErrorMethod, jerr);
+    env->DeleteLocalRef(jerr);
+}
+
+static void callback_complete(JNIEnv * env, jobject callback, const std::string & text) {
+    jclass cbClass = env->GetObjectClass(callback);
+    jmethodID onCompleteMethod = env->GetMethodID(cbClass, "onComplete", "(Ljava/lang/String;)V");
+    jstring jresult = env->NewStringUTF(text.c_str());
+    env->CallVoidMethod(callback, onCompleteMethod, jresult);
+    env->DeleteLocalRef(jresult);
+}
+
+static llama_sampler * make_sampler(uint32_t seed = LLAMA_DEFAULT_SEED) {
+    llama_sampler_chain_params sparams = llama_sampler_chain_default_params();
+    llama_sampler * sampler = llama_sampler_chain_init(sparams);
+    llama_sampler_chain_add(sampler, llama_sampler_init_penalties(PENALTY_LAST_N, 1.3f, 0.0f, 0.0f));
+    llama_sampler_chain_add(sampler, llama_sampler_init_min_p(0.05f, 1));
+    llama_sampler_chain_add(sampler, llama_sampler_init_temp(0.7f));
+    llama_sampler_chain_add(sampler, llama_sampler_init_dist(seed));
+    return sampler;
+}
+
 static void create_sampler(VisionAIContext * vctx) {
     if (vctx->sampler) {
         llama_sampler_free(vctx->sampler);
     }
-    llama_sampler_chain_params sparams = llama_sampler_chain_default_params();
-    vctx->sampler = llama_sampler_chain_init(sparams);
-    llama_sampler_chain_add(vctx->sampler, llama_sampler_init_penalties(64, 1.3f, 0.0f, 0.0f));
-    llama_sampler_chain_add(vctx->sampler, llama_sampler_init_min_p(0.05f, 1));
-    llama_sampler_chain_add(vctx->sampler, llama_sampler_init_temp(0.7f));
-    llama_sampler_chain_add(vctx->sampler, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
+    vctx->sampler = make_sampler();
 }
 
-// Apply the model's chat template to format the prompt correctly
-static std::string apply_chat_template(const llama_model * model, const std::string & user_content) {
+static const char * SYSTEM_PROMPT =
+    "You are an image understanding model capable of describing the salient features of any image.";
+
+// Apply the model's chat template to the system message followed by `turns`
+static std::string format_chat(const llama_model * model,
+                               const std::vector<std::pair<std::string, std::string>> & turns,
+                               bool add_assistant) {
     const char * tmpl = llama_model_chat_template(model, nullptr);
 
-    llama_chat_message messages[] = {
-        { "system",    "You are an image understanding model capable of describing the salient features of any image." },
-        { "user",      user_content.c_str() },
-    };
+    std::vector<llama_chat_message> messages;
+    messages.push_back({ "system", SYSTEM_PROMPT });
+    for (const auto & turn : turns) {
+        messages.push_back({ turn.first.c_str(), turn.second.c_str() });
+    }
 
     // First call: get required buffer size
-    int32_t len = llama_chat_apply_template(tmpl, messages, 2, true, nullptr, 0);
+    int32_t len = llama_chat_apply_template(tmpl, messages.data(), messages.size(), add_assistant, nullptr, 0);
     if (len < 0) {
         LOGE("chat template failed, falling back to raw prompt");
-        return user_content;
+        return turns.empty() ? std::string() : turns.back().second;
     }
 
     std::vector<char> buf(len + 1);
-    llama_chat_apply_template(tmpl, messages, 2, true, buf.data(), buf.size());
+    llama_chat_apply_template(tmpl, messages.data(), messages.size(), add_assistant, buf.data(), buf.size());
     buf[len] = '\0';
 
-    std::string result(buf.data(), len);
-    LOGI("Formatted prompt (%d chars): %.200s...", len, result.c_str());
-    return result;
+    return std::string(buf.data(), len);
 }
 
-// Helper: run token generation loop, returns response string
-static std::string generate_response(VisionAIContext * vctx, int max_tokens) {
-    const llama_vocab * vocab = llama_model_get_vocab(vctx->model);
-    std::string response;
-    int tokens_generated = 0;
+// Apply the model's chat template to format the prompt correctly
+static std::string apply_chat_template(const llama_model * model, const std::string & user_content) {
+    std::string result = format_chat(model, { { "user", user_content } }, true);
+    LOGI("Formatted prompt (%zu chars): %.200s...", result.size(), result.c_str());
+    return result;
+}
 
-    auto t_gen_start = steady_clock::now();
+// Video layout of the user turn: the prompt, then one marker per frame
+static std::string frames_user_content(const std::string & prompt, size_t n_frames) {
+    const std::string marker = mtmd_default_marker();
+    std::string user_content = prompt + "\n";
+    for (size_t i = 0; i < n_frames; i++) {
+        user_content += marker + "\n";
+    }
+    return user_content;
+}
 
-    for (int i = 0; i < max_tokens; i++) {
-        llama_token token_id = llama_sampler_sample(vctx->sampler, vctx->ctx, -1);
+// Build the user turn: a single image goes before the prompt, while multi-frame (video)
+// input puts the prompt BEFORE the markers so the instruction has more weight
+static std::string build_user_content(const std::string & prompt, size_t n_images) {
+    if (n_images == 1) {
+        return std::string(mtmd_default_marker()) + "\n" + prompt;
+    }
+    return frames_user_content(prompt, n_images);
+}
 
-        if (llama_vocab_is_eog(vocab, token_id)) {
-            break;
-        }
+static std::string strip_whitespace(const std::string & text) {
+    const size_t begin = text.find_first_not_of(" \t\n");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    return text.substr(begin, text.find_last_not_of(" \t\n") - begin + 1);
+}
 
-        tokens_generated++;
+static std::vector<llama_token> tokenize_text(const llama_vocab * vocab, const std::string & text) {
+    int32_t n = -llama_tokenize(vocab, text.data(), text.size(), nullptr, 0, false, true);
+    std::vector<llama_token> tokens(n);
+    llama_tokenize(vocab, text.data(), text.size(), tokens.data(), n, false, true);
+    return tokens;
+}
 
-        char buf[256];
-        int n = llama_token_to_piece(vocab, token_id, buf, sizeof(buf), 0, true);
-        if (n > 0) {
-            response.append(buf, n);
+// Decode text tokens into `seq_id` in N_BATCH sized batches, advancing n_past
+static bool decode_tokens(VisionAIContext * vctx, const llama_token * tokens, size_t n_tokens,
+                          llama_seq_id seq_id, llama_pos & n_past, bool logits_last) {
+    llama_batch batch = llama_batch_init(N_BATCH, 0, 1);
+    for (size_t i = 0; i < n_tokens; i += N_BATCH) {
+        const int32_t n_eval = (int32_t) std::min<size_t>(N_BATCH, n_tokens - i);
+        batch.n_tokens = n_eval;
+        for (int32_t j = 0; j < n_eval; j++) {
+            batch.token[j]     = tokens[i + j];
+            batch.pos[j]       = n_past + j;
+            batch.n_seq_id[j]  = 1;
+            batch.seq_id[j][0] = seq_id;
+            batch.logits[j]    = logits_last && (i + j == n_tokens - 1);
         }
-
-        llama_batch batch = llama_batch_get_one(&token_id, 1);
-        if (llama_decode(vctx->ctx, batch) != 0) {
-            LOGE("Failed to decode token at position %d", i);
-            break;
+        if (is_cancelled(vctx) || decode_batch(vctx, batch) != 0) {
+            if (is_cancelled(vctx)) {
+                LOGI("Prefill cancelled at position %d", n_past);
+            } else {
+                LOGE("Failed to decode text batch at position %d", n_past);
+            }
+            llama_batch_free(batch);
+            return false;
         }
+        n_past += n_eval;
     }
+    llama_batch_free(batch);
+    return true;
+}
 
-    auto t_gen_end = steady_clock::now();
-    long long gen_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_gen_end - t_gen_start).count();
-    float tok_s = tokens_generated > 0 && gen_ms > 0 ? (tokens_generated * 1000.0f / gen_ms) : 0;
-    LOGI("  Generation: %lld ms (%d tokens, %.1f tok/s)", gen_ms, tokens_generated, tok_s);
-
-    return response;
+// FNV-1a over the pixels and dimensions, identifies an image in prefix cache keys
+static uint64_t hash_image(const unsigned char * rgb, uint32_t width, uint32_t height) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto mix = [&h](uint64_t v) { h = (h ^ v) * 0x100000001b3ull; };
+    mix(width);
+    mix(height);
+    const size_t n_bytes = (size_t) width * height * 3;
+    for (size_t i = 0; i < n_bytes; i++) {
+        mix(rgb[i]);
+    }
+    return h;
 }
 
-// Helper: streaming token generation with JNI callback
-static std::string generate_response_streaming(
-        VisionAIContext * vctx, int max_tokens,
-        JNIEnv * env, jobject callback) {
+// Read the encoder's input geometry straight from the mmproj header; mtmd keeps it private
+static void read_encoder_geometry(VisionAIContext * vctx, const char * mmproj_path) {
+    gguf_init_params params = { /* no_alloc */ true, /* ctx */ nullptr };
+    gguf_context * gguf = gguf_init_from_file(mmproj_path, params);
+    if (!gguf) {
+        return;
+    }
+    auto get_u32 = [gguf](const char * key) {
+        const int64_t id = gguf_find_key(gguf, key);
+        return id >= 0 && gguf_get_kv_type(gguf, id) == GGUF_TYPE_UINT32 ? (int) gguf_get_val_u32(gguf, id) : 0;
+    };
+    vctx->encoder_image_size   = get_u32("clip.vision.image_size");
+    vctx->encoder_preproc_size = get_u32("clip.vision.preproc_image_size");
+    gguf_free(gguf);
 
-    const llama_vocab * vocab = llama_model_get_vocab(vctx->model);
-    std::string response;
-    int tokens_generated = 0;
+    LOGI("Encoder geometry: %d px tiles, %d px preprocess size",
+         vctx->encoder_image_size, vctx->encoder_preproc_size);
+}
 
-    // Cache JNI method IDs for the callback interface
-    jclass cbClass = env->GetObjectClass(callback);
-    jmethodID onTokenMethod = env->GetMethodID(cbClass, "onToken", "(Ljava/lang/String;)V");
+// Size the clip preprocessor would resize an image to, so handing it exactly that spares it
+// resampling the image itself. Tiling encoders (SmolVLM) scale the long side to the preprocess
+// size and round both sides up to whole tiles; rounding to the nearest tile instead keeps a
+// sliver of aspect ratio from costing a full extra row of tiles. Others take the long side to
+// one tile. Tiling encoders still get an overview thumbnail, which clip downscales to one tile.
+static void encoder_input_size(const VisionAIContext * vctx, uint32_t width, uint32_t height,
+                               uint32_t & out_w, uint32_t & out_h) {
+    const int tile = vctx->encoder_image_size;
+    const int longest = vctx->encoder_preproc_size > 0 ? vctx->encoder_preproc_size : tile;
+    if (tile <= 0 || width == 0 || height == 0) {
+        out_w = width;
+        out_h = height;
+        return;
+    }
 
-    auto t_gen_start = steady_clock::now();
+    const float scale = (float) longest / std::max(width, height);
+    if (vctx->encoder_preproc_size > 0) {
+        auto tiles = [&](uint32_t side) { return std::max(1, (int) std::lround(side * scale / tile)); };
+        out_w = (uint32_t) (tiles(width)  * tile);
+        out_h = (uint32_t) (tiles(height) * tile);
+    } else {
+        out_w = (uint32_t) std::max(1, (int) std::lround(width  * scale));
+        out_h = (uint32_t) std::max(1, (int) std::lround(height * scale));
+    }
+}
 
-    for (int i = 0; i < max_tokens; i++) {
-        llama_token token_id = llama_sampler_sample(vctx->sampler, vctx->ctx, -1);
+// Pixels at the encoder's input geometry, with the hash of the image as given
+struct PreparedImage {
+    std::vector<unsigned char> resized; // empty when the image already had that geometry
+    const unsigned char * rgb = nullptr;
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    uint64_t hash   = 0;
+};
 
-        if (llama_vocab_is_eog(vocab, token_id)) {
-            break;
-        }
+// Hash and resample a frame for the encoder. Touches no mtmd or llama state (the encoder
+// geometry is fixed at load), so it may run on a helper thread while the encoder works.
+static PreparedImage prepare_image(const VisionAIContext * vctx, const unsigned char * rgb,
+                                   uint32_t width, uint32_t height) {
+    PreparedImage img;
+    img.hash   = hash_image(rgb, width, height);
+    img.rgb    = rgb;
+    img.width  = width;
+    img.height = height;
+
+    uint32_t enc_w, enc_h;
+    encoder_input_size(vctx, width, height, enc_w, enc_h);
+    if (enc_w != width || enc_h != height) {
+        img.resized.resize((size_t) enc_w * enc_h * 3);
+        resize_rgb(img.resized.data(), (int) enc_w, (int) enc_h, rgb, (int) width, (int) height);
+        LOGI("Encoder input: %ux%u -> %ux%u", width, height, enc_w, enc_h);
+        img.rgb    = img.resized.data();
+        img.width  = enc_w;
+        img.height = enc_h;
+    }
+    return img;
+}
 
-        tokens_generated++;
+// mtmd_tokenize (clip preprocessing) on a prepared frame. It goes through the shared mtmd
+// context, so it runs on the thread that owns the encoder, never next to mtmd_encode_chunk.
+static ImageEmbedding * tokenize_prepared(const VisionAIContext * vctx, const PreparedImage & img) {
+    // mtmd_bitmap is the only way into the encoder: clip's float image type and context are
+    // private to mtmd, so its u8 -> f32 normalisation (and, for tiling encoders, the overview
+    // thumbnail) cannot be done here instead.
+    mtmd_bitmap * bmp = mtmd_bitmap_init(img.width, img.height, img.rgb);
 
-        char buf[256];
-        int n = llama_token_to_piece(vocab, token_id, buf, sizeof(buf), 0, true);
-        if (n > 0) {
-            response.append(buf, n);
+    mtmd_input_text text;
+    text.text          = mtmd_default_marker();
+    text.add_special   = false;
+    text.parse_special = true;
 
-            // Call Java callback with the token piece
-            jstring jtoken = env->NewStringUTF(std::string(buf, n).c_str());
-            env->CallVoidMethod(callback, onTokenMethod, jtoken);
-            env->DeleteLocalRef(jtoken);
-        }
+    auto * emb = new ImageEmbedding();
+    emb->chunks = mtmd_input_chunks_init();
+    emb->hash   = img.hash;
 
-        llama_batch batch = llama_batch_get_one(&token_id, 1);
-        if (llama_decode(vctx->ctx, batch) != 0) {
-            LOGE("Failed to decode token at position %d", i);
-            break;
-        }
+    const mtmd_bitmap * bitmaps[] = { bmp };
+    int32_t tokenize_res = mtmd_tokenize(vctx->ctx_mtmd, emb->chunks, &text, bitmaps, 1);
+    mtmd_bitmap_free(bmp);
+    if (tokenize_res != 0) {
+        LOGE("Failed to tokenize image, error: %d", tokenize_res);
+        delete emb;
+        return nullptr;
     }
-
-    auto t_gen_end = steady_clock::now();
-    long long gen_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t_gen_end - t_gen_start).count();
-    float tok_s = tokens_generated > 0 && gen_ms > 0 ? (tokens_generated * 1000.0f / gen_ms) : 0;
-    LOGI("  Generation (streaming): %lld ms (%d tokens, %.1f tok/s)", gen_ms, tokens_generated, tok_s);
-
-    return response;
+    return emb;
 }
 
-extern "C" {
+// CPU half of encoding: hash, resize and mtmd_tokenize
+static ImageEmbedding * tokenize_image(const VisionAIContext * vctx, const unsigned char * rgb,
+                                       uint32_t width, uint32_t height) {
+    return tokenize_prepared(vctx, prepare_image(vctx, rgb, width, height));
+}
 
-// Load the LLM model + multimodal projector
-JNIEXPORT jlong JNICALL
-Java_com_example_visionai_inference_LlamaModel_loadModel(
-        JNIEnv * env, jobject /* thiz */,
-        jstring model_path, jstring mmproj_path,
-        jint n_threads, jint n_ctx) {
+// Run the vision encoder over every image chunk of a tokenized image; false on failure or cancel
+// `max_tokens` caps the image's visual tokens (0 = no cap) by merging down to fit. `req` is the
+// request to stop for, when it is not the context's active one (the continuous worker's own).
+static bool encode_chunks(VisionAIContext * vctx, ImageEmbedding * emb, size_t max_tokens = 0,
+                          const Request * req = nullptr) {
+    const Request * cancel = req ? req : vctx->active.load();
+    const size_t n_embd   = llama_model_n_embd_inp(vctx->model);
+    const size_t n_chunks = mtmd_input_chunks_size(emb->chunks);
+    emb->embd.resize(n_chunks);
+
+    // Survivors of a merge are decoded at consecutive positions, which is only right for
+    // causal, 1D-position decoders; the others keep every token whatever the budget
+    const bool mergeable = !mtmd_decode_use_non_causal(vctx->ctx_mtmd) && !mtmd_decode_use_mrope(vctx->ctx_mtmd);
+    float keep = vctx->token_keep_ratio.load();
+    if (max_tokens > 0) {
+        size_t n_image = 0;
+        for (size_t i = 0; i < n_chunks; i++) {
+            const mtmd_input_chunk * chunk = mtmd_input_chunks_get(emb->chunks, i);
+            if (mtmd_input_chunk_get_type(chunk) == MTMD_INPUT_CHUNK_TYPE_IMAGE) {
+                n_image += mtmd_input_chunk_get_n_tokens(chunk);
+            }
+        }
+        if (n_image > max_tokens) {
+            keep = std::min(keep, (float) max_tokens / n_image);
+        }
+    }
 
-    const char * model_path_c  = env->GetStringUTFChars(model_path, nullptr);
-    const char * mmproj_path_c = env->GetStringUTFChars(mmproj_path, nullptr);
+    for (size_t i = 0; i < n_chunks; i++) {
+        const mtmd_input_chunk * chunk = mtmd_input_chunks_get(emb->chunks, i);
+        const size_t n_tokens = mtmd_input_chunk_get_n_tokens(chunk);
+        emb->n_tokens += n_tokens;
+        emb->n_pos    += mtmd_input_chunk_get_n_pos(chunk);
 
-    auto * vctx = new VisionAIContext();
-    vctx->n_threads = n_threads;
+        if (mtmd_input_chunk_get_type(chunk) != MTMD_INPUT_CHUNK_TYPE_IMAGE) {
+            continue;
+        }
 
-    LOGI("Loading model: %s", model_path_c);
-    LOGI("Loading mmproj: %s", mmproj_path_c);
+        // mtmd has no abort hook, so the encoder can only stop between slices
+        if (is_cancelled(cancel)) {
+            LOGI("Image encoding cancelled at chunk %zu", i);
+            return false;
+        }
 
-    ggml_backend_load_all();
+        {
+            std::unique_lock<std::mutex> lock(vctx->compute_mtx, std::defer_lock);
+            if (vctx->encoder_shares_gpu) {
+                lock.lock();
+            }
+            int32_t encode_res = mtmd_encode_chunk(vctx->ctx_mtmd, chunk);
+            if (encode_res != 0) {
+                LOGE("Failed to encode image chunk %zu, error: %d", i, encode_res);
+                return false;
+            }
+            const float * out = mtmd_get_output_embd(vctx->ctx_mtmd);
+            emb->embd[i].assign(out, out + n_tokens * n_embd);
+        }
 
-    // Log available backends
-    size_t n_backends = ggml_backend_dev_count();
-    LOGI("Available backends: %zu", n_backends);
-    for (size_t i = 0; i < n_backends; i++) {
-        ggml_backend_dev_t dev = ggml_backend_dev_get(i);
-        LOGI("  Backend %zu: %s (%s)", i, ggml_backend_dev_name(dev), ggml_backend_dev_description(dev));
+        // Merge redundant visual tokens before they reach prefill
+        if (keep < 1.0f && mergeable) {
+            const size_t n_keep = (size_t) std::lround(n_tokens * keep);
+            const size_t n_left = merge_tokens(emb->embd[i].data(), n_tokens, n_embd, n_keep);
+            emb->embd[i].resize(n_left * n_embd);
+            emb->n_tokens -= n_tokens - n_left;
+            emb->n_pos    -= (llama_pos) (n_tokens - n_left);
+            LOGI("Image chunk %zu: merged %zu visual tokens into %zu", i, n_tokens, n_left);
+        }
+    }
+    if (keep < 1.0f && !mergeable) {
+        LOGE("Token merging bypassed for a %s decoder: %zu visual tokens%s",
+             mtmd_decode_use_mrope(vctx->ctx_mtmd) ? "M-RoPE" : "non-causal", emb->n_tokens,
+             max_tokens > 0 && emb->n_tokens > max_tokens ? ", over the budget" : "");
     }
+    return true;
+}
 
-    llama_model_params model_params = llama_model_default_params();
-    model_params.n_gpu_layers = 99; // Offload all layers to GPU (OpenCL/Adreno)
-    vctx->model = llama_model_load_from_file(model_path_c, model_params);
+// Tokenize a media marker with the image and run every image chunk through the encoder
+static ImageEmbedding * encode_image(VisionAIContext * vctx, const unsigned char * rgb,
+                                     uint32_t width, uint32_t height, size_t max_tokens = 0,
+                                     const Request * req = nullptr) {
+    std::unique_ptr<ImageEmbedding> emb(tokenize_image(vctx, rgb, width, height));
+    return emb && encode_chunks(vctx, emb.get(), max_tokens, req) ? emb.release() : nullptr;
+}
 
-    if (!vctx->model) {
-        LOGE("Failed to load model");
-        env->ReleaseStringUTFChars(model_path, model_path_c);
-        env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
-        delete vctx;
-        throw_java_exception(env, "Failed to load model");
-        return 0;
+// Visual tokens the images will occupy in the prompt, after any merging
+static size_t visual_tokens(VisionAIContext * vctx, const std::vector<ImageEmbedding *> & images) {
+    const size_t n_embd = llama_model_n_embd_inp(vctx->model);
+    size_t n = 0;
+    for (const ImageEmbedding * emb : images) {
+        for (const auto & rows : emb->embd) {
+            n += rows.size() / n_embd;
+        }
     }
+    return n;
+}
 
-    llama_context_params ctx_params = llama_context_default_params();
-    ctx_params.n_ctx            = n_ctx;
-    ctx_params.n_batch          = 512;  // Larger batches for faster prompt eval
-    ctx_params.n_threads        = n_threads;
-    ctx_params.flash_attn_type  = LLAMA_FLASH_ATTN_TYPE_ENABLED;
-    vctx->ctx = llama_init_from_model(vctx->model, ctx_params);
+// Mean of an image's visual tokens, L2-normalised: one vector per image to compare scenes by
+static std::vector<float> pooled_embedding(const VisionAIContext * vctx, const ImageEmbedding * emb) {
+    const size_t n_embd = llama_model_n_embd_inp(vctx->model);
+    std::vector<float> pooled(n_embd, 0.0f);
+    for (const auto & rows : emb->embd) {
+        for (size_t i = 0; i < rows.size(); i += n_embd) {
+            for (size_t k = 0; k < n_embd; k++) {
+                pooled[k] += rows[i + k];
+            }
+        }
+    }
+    float norm = 0.0f;
+    for (float v : pooled) {
+        norm += v * v;
+    }
+    const float inv = norm > 0.0f ? 1.0f / std::sqrt(norm) : 0.0f;
+    for (float & v : pooled) {
+        v *= inv;
+    }
+    return pooled;
+}
 
-    if (!vctx->ctx) {
-        LOGE("Failed to create llama context");
-        llama_model_free(vctx->model);
-        env->ReleaseStringUTFChars(model_path, model_path_c);
-        env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
-        delete vctx;
-        throw_java_exception(env, "Failed to create llama context");
-        return 0;
+// Change gate: whether an encoded frame differs from the last one let through by at least the
+// gate threshold (cosine distance of pooled embeddings). A frame that passes becomes the reference.
+static bool scene_changed(VisionAIContext * vctx, const ImageEmbedding * emb,
+                          steady_clock::time_point t_start) {
+    if (vctx->gate_reset.exchange(false)) {
+        vctx->gate_anchor.clear();
+    }
+    std::vector<float> pooled = pooled_embedding(vctx, emb);
+    float distance = 1.0f;
+    if (vctx->gate_anchor.size() == pooled.size()) {
+        float dot = 0.0f;
+        for (size_t k = 0; k < pooled.size(); k++) {
+            dot += pooled[k] * vctx->gate_anchor[k];
+        }
+        distance = 1.0f - dot;
     }
 
-    mtmd_context_params mparams = mtmd_context_params_default();
-    mparams.use_gpu   = true; // Use GPU (OpenCL/Adreno) for vision encoder too
-    mparams.n_threads = n_threads;
+    const bool changed = distance >= vctx->gate_threshold.load();
+    vctx->gate_frames++;
+    vctx->gate_last_distance = distance;
+    if (changed) {
+        vctx->gate_anchor = std::move(pooled);
+    } else {
+        vctx->gate_skipped++;
+    }
 
-    vctx->ctx_mtmd = mtmd_init_from_file(mmproj_path_c, vctx->model, mparams);
+    LOGI("=== CHANGE GATE === Distance: %.4f -> %s | Skipped: %u/%u | Encode: %lld ms",
+         distance, changed ? "changed" : "unchanged", vctx->gate_skipped.load(), vctx->gate_frames.load(),
+         elapsed_ms(t_start, steady_clock::now()));
+    return changed;
+}
 
-    if (!vctx->ctx_mtmd) {
-        LOGE("Failed to load multimodal projector");
-        llama_free(vctx->ctx);
-        llama_model_free(vctx->model);
-        env->ReleaseStringUTFChars(model_path, model_path_c);
-        env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
-        delete vctx;
-        throw_java_exception(env, "Failed to load multimodal projector");
-        return 0;
+// Tell the active request how many visual tokens it ended up with
+static void report_visual_tokens(VisionAIContext * vctx, const std::vector<ImageEmbedding *> & images) {
+    const size_t n = visual_tokens(vctx, images);
+    if (Request * req = vctx->active.load()) {
+        req->n_visual_tokens = n;
     }
+    LOGI("Visual tokens: %zu", n);
+}
 
-    create_sampler(vctx);
+// Decode image embeddings that token merging shortened, at consecutive positions. Unmerged
+// chunks go through mtmd_helper_decode_image_chunk, which knows every model's position layout.
+static bool decode_embeddings(VisionAIContext * vctx, const float * embd, size_t n_rows,
+                              llama_seq_id seq_id, llama_pos & n_past) {
+    const size_t n_embd = llama_model_n_embd_inp(vctx->model);
+    llama_batch batch = llama_batch_init(N_BATCH, (int32_t) n_embd, 1);
+    for (size_t i = 0; i < n_rows; i += N_BATCH) {
+        const int32_t n_eval = (int32_t) std::min<size_t>(N_BATCH, n_rows - i);
+        batch.n_tokens = n_eval;
+        memcpy(batch.embd, embd + i * n_embd, n_eval * n_embd * sizeof(float));
+        for (int32_t j = 0; j < n_eval; j++) {
+            batch.pos[j]       = n_past + j;
+            batch.n_seq_id[j]  = 1;
+            batch.seq_id[j][0] = seq_id;
+            batch.logits[j]    = false;
+        }
+        if (is_cancelled(vctx) || decode_batch(vctx, batch) != 0) {
+            if (is_cancelled(vctx)) {
+                LOGI("Prefill cancelled at position %d", n_past);
+            } else {
+                LOGE("Failed to decode image batch at position %d", n_past);
+            }
+            llama_batch_free(batch);
+            return false;
+        }
+        n_past += n_eval;
+    }
+    llama_batch_free(batch);
+    return true;
+}
 
-    env->ReleaseStringUTFChars(model_path, model_path_c);
-    env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
+// Feed a pre-encoded image into the KV cache without touching the vision encoder
+static bool decode_image(VisionAIContext * vctx, ImageEmbedding * emb,
+                         llama_seq_id seq_id, llama_pos & n_past) {
+    const size_t n_chunks = mtmd_input_chunks_size(emb->chunks);
+    for (size_t i = 0; i < n_chunks; i++) {
+        const mtmd_input_chunk * chunk = mtmd_input_chunks_get(emb->chunks, i);
+
+        if (mtmd_input_chunk_get_type(chunk) == MTMD_INPUT_CHUNK_TYPE_TEXT) {
+            size_t n_tokens = 0;
+            const llama_token * tokens = mtmd_input_chunk_get_tokens_text(chunk, &n_tokens);
+            if (!decode_tokens(vctx, tokens, n_tokens, seq_id, n_past, false)) {
+                return false;
+            }
+            continue;
+        }
 
-    const char * chat_tmpl = llama_model_chat_template(vctx->model, nullptr);
-    LOGI("Model loaded successfully, vision support: %s, chat template: %s",
-         mtmd_support_vision(vctx->ctx_mtmd) ? "yes" : "no",
-         chat_tmpl ? "yes" : "no");
+        const size_t n_rows = emb->embd[i].size() / llama_model_n_embd_inp(vctx->model);
+        if (n_rows < mtmd_input_chunk_get_n_tokens(chunk)) {
+            if (!decode_embeddings(vctx, emb->embd[i].data(), n_rows, seq_id, n_past)) {
+                return false;
+            }
+            continue;
+        }
 
-    return reinterpret_cast<jlong>(vctx);
+        std::unique_lock<std::mutex> lock(vctx->compute_mtx);
+        int32_t res = mtmd_helper_decode_image_chunk(
+            vctx->ctx_mtmd, vctx->ctx, chunk, emb->embd[i].data(),
+            n_past, seq_id, N_BATCH, &n_past
+        );
+        lock.unlock();
+        if (res != 0) {
+            LOGE("Failed to decode image chunk %zu, error: %d", i, res);
+            return false;
+        }
+    }
+    return true;
 }
 
-// Single image inference
-JNIEXPORT jstring JNICALL
-Java_com_example_visionai_inference_LlamaModel_runInference(
-        JNIEnv * env, jobject /* thiz */,
-        jlong ctx_ptr, jbyteArray image_bytes, jint width, jint height,
-        jstring prompt) {
-
-    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
-    if (!vctx || !vctx->model || !vctx->ctx || !vctx->ctx_mtmd) {
-        throw_java_exception(env, "Model not loaded");
-        return env->NewStringUTF("");
+// Prefill the part of the chat template that precedes the user content into SEQ_SYSTEM.
+// It is identical for every request, so each one starts from a copy of these cells.
+static void prefill_system_prompt(VisionAIContext * vctx) {
+    static const char * SENTINEL = "\x01user\x01";
+    const std::string formatted = format_chat(vctx->model, { { "user", SENTINEL } }, true);
+    const size_t at = formatted.find(SENTINEL);
+    if (at == std::string::npos || at == 0) {
+        LOGE("Could not locate the system prefix in the chat template");
+        return;
     }
 
-    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
-    jbyte * img_data = env->GetByteArrayElements(image_bytes, nullptr);
-
-    LOGI("Running inference: %dx%d image", width, height);
     auto t_start = steady_clock::now();
+    const std::string prefix = formatted.substr(0, at);
+    std::vector<llama_token> tokens = tokenize_text(llama_model_get_vocab(vctx->model), prefix);
 
-    mtmd_bitmap * bmp = mtmd_bitmap_init(
-        (uint32_t)width, (uint32_t)height,
-        reinterpret_cast<const unsigned char *>(img_data)
-    );
+    llama_pos n_past = 0;
+    if (!decode_tokens(vctx, tokens.data(), tokens.size(), SEQ_SYSTEM, n_past, false)) {
+        llama_memory_seq_rm(llama_get_memory(vctx->ctx), SEQ_SYSTEM, -1, -1);
+        return;
+    }
 
-    // Build user content with image marker + prompt, then apply chat template
-    const char * marker = mtmd_default_marker();
-    std::string user_content = std::string(marker) + "\n" + prompt_c;
-    std::string formatted = apply_chat_template(vctx->model, user_content);
+    vctx->system_prefix = prefix;
+    vctx->system_tokens = std::move(tokens);
+    vctx->seq_in_use[SEQ_SYSTEM] = true;
+    LOGI("System prompt snapshot: %d tokens in %lld ms", n_past, elapsed_ms(t_start, steady_clock::now()));
+}
 
-    mtmd_input_text text;
-    text.text          = formatted.c_str();
-    text.add_special   = false; // chat template already includes BOS
-    text.parse_special = true;
+// A prompt split for evaluation: a run of text tokens or one pre-encoded image
+struct PromptSegment {
+    std::vector<llama_token> tokens;
+    ImageEmbedding * image = nullptr;
+};
 
-    const mtmd_bitmap * bitmaps[] = { bmp };
-    mtmd_input_chunks * chunks = mtmd_input_chunks_init();
+// Tokenize a chat-formatted prompt, pairing each media marker with the next image. The system
+// prefix stays a segment of its own so it tokenizes exactly like the SEQ_SYSTEM snapshot.
+static bool split_prompt(VisionAIContext * vctx, const std::string & formatted,
+                         const std::vector<ImageEmbedding *> & images,
+                         std::vector<PromptSegment> & segments) {
+    const llama_vocab * vocab = llama_model_get_vocab(vctx->model);
+    const std::string marker = mtmd_default_marker();
 
-    int32_t tokenize_res = mtmd_tokenize(vctx->ctx_mtmd, chunks, &text, bitmaps, 1);
-    if (tokenize_res != 0) {
-        LOGE("Failed to tokenize, error: %d", tokenize_res);
-        mtmd_input_chunks_free(chunks);
-        mtmd_bitmap_free(bmp);
-        env->ReleaseByteArrayElements(image_bytes, img_data, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        throw_java_exception(env, "Failed to tokenize input");
-        return env->NewStringUTF("");
+    size_t pos = 0;
+    const std::string & prefix = vctx->system_prefix;
+    if (!vctx->system_tokens.empty() && formatted.compare(0, prefix.size(), prefix) == 0) {
+        segments.push_back({ vctx->system_tokens, nullptr });
+        pos = prefix.size();
     }
 
-    llama_memory_clear(llama_get_memory(vctx->ctx), true);
-    create_sampler(vctx); // Reset sampler state
+    size_t n_used = 0;
+    while (true) {
+        const size_t next = formatted.find(marker, pos);
+        const bool is_last = next == std::string::npos;
+        const std::string piece = formatted.substr(pos, is_last ? std::string::npos : next - pos);
 
-    auto t_after_tokenize = steady_clock::now();
+        if (!piece.empty()) {
+            segments.push_back({ tokenize_text(vocab, piece), nullptr });
+        }
+        if (is_last) {
+            break;
+        }
 
-    llama_pos n_past = 0;
-    int32_t eval_res = mtmd_helper_eval_chunks(
-        vctx->ctx_mtmd, vctx->ctx, chunks,
-        n_past, 0, 128, true, &n_past
-    );
-
-    if (eval_res != 0) {
-        LOGE("Failed to evaluate chunks, error: %d", eval_res);
-        mtmd_input_chunks_free(chunks);
-        mtmd_bitmap_free(bmp);
-        env->ReleaseByteArrayElements(image_bytes, img_data, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        throw_java_exception(env, "Failed to evaluate input");
-        return env->NewStringUTF("");
+        if (n_used >= images.size()) {
+            LOGE("Prompt has more media markers than images (%zu)", images.size());
+            return false;
+        }
+        segments.push_back({ {}, images[n_used++] });
+        pos = next + marker.size();
     }
 
-    auto t_after_eval = steady_clock::now();
+    if (n_used != images.size()) {
+        LOGE("Prompt used %zu of %zu images", n_used, images.size());
+        return false;
+    }
+    if (segments.empty() || segments.back().image) {
+        LOGE("Prompt must end with text to produce logits");
+        return false;
+    }
+    return true;
+}
 
-    std::string response = generate_response(vctx, MAX_TOKENS);
+// Prefix cache key: one item per text token and one per image, the image's content hash with
+// the top bit set so it never equals a token id. The hash is mixed with the image's KV length,
+// so the same picture merged to a different number of visual tokens is a different item.
+static PrefixCache::Key prompt_key(const std::vector<PromptSegment> & segments) {
+    PrefixCache::Key key;
+    for (const auto & seg : segments) {
+        if (seg.image) {
+            key.push_back((seg.image->hash ^ ((uint64_t) seg.image->n_pos * 0x9e3779b97f4a7c15ull)) | (1ull << 63));
+            continue;
+        }
+        for (llama_token token : seg.tokens) {
+            key.push_back((uint32_t) token);
+        }
+    }
+    return key;
+}
 
-    auto t_end = steady_clock::now();
-    auto ms = [](steady_clock::time_point a, steady_clock::time_point b) {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
-    };
-    LOGI("=== PHOTO BENCHMARK === Tokenize: %lld ms | Eval: %lld ms | Total: %lld ms",
-         ms(t_start, t_after_tokenize), ms(t_after_tokenize, t_after_eval), ms(t_start, t_end));
+// Clear `seq_id` and refill it with the longest already evaluated prefix of the prompt: a
+// cached state when one reaches past the system prompt, otherwise the SEQ_SYSTEM snapshot.
+// Returns how many key items need no evaluation.
+static size_t restore_prefix(VisionAIContext * vctx, const std::vector<PromptSegment> & segments,
+                             const PrefixCache::Key & key, llama_seq_id seq_id,
+                             llama_pos & n_past, bool & exact) {
+    llama_memory_t mem = llama_get_memory(vctx->ctx);
+    llama_memory_seq_rm(mem, seq_id, -1, -1);
+    n_past = 0;
+    exact  = false;
+
+    const bool has_system = !vctx->system_tokens.empty() && segments[0].tokens == vctx->system_tokens;
+    const size_t n_system = has_system ? vctx->system_tokens.size() : 0;
+
+    // The last token is always decoded again for its logits
+    PrefixCache::Match match = vctx->prefix_cache.lookup(key, n_system + 1, key.size() - 1);
+    std::unique_lock<std::mutex> lock(vctx->compute_mtx);
+    const bool restored = match.state &&
+            llama_state_seq_set_data(vctx->ctx, match.state->data(), match.state->size(), seq_id) != 0;
+    lock.unlock();
+    if (restored) {
+        // The state may run past the match: keep only the positions of the matched items
+        size_t n_items = 0;
+        for (const auto & seg : segments) {
+            const size_t n_seg = seg.image ? 1 : seg.tokens.size();
+            if (n_items + n_seg > match.n_items) {
+                n_past += match.n_items - n_items; // images are one item, so this is a text run
+                break;
+            }
+            n_items += n_seg;
+            n_past  += seg.image ? seg.image->n_pos : (llama_pos) n_seg;
+        }
+        llama_memory_seq_rm(mem, seq_id, n_past, -1);
+        exact = match.exact;
+        return match.n_items;
+    }
+
+    llama_memory_seq_rm(mem, seq_id, -1, -1);
+    n_past = 0;
+    if (has_system) {
+        llama_memory_seq_cp(mem, SEQ_SYSTEM, seq_id, 0, (llama_pos) n_system);
+        n_past = (llama_pos) n_system;
+    }
+    return n_system;
+}
+
+// Evaluate the segments past the first `n_skip` key items, which are already in the KV cache
+static bool eval_segments(VisionAIContext * vctx, const std::vector<PromptSegment> & segments,
+                          size_t n_skip, llama_seq_id seq_id, llama_pos & n_past) {
+    for (size_t i = 0; i < segments.size(); i++) {
+        const PromptSegment & seg = segments[i];
+        if (seg.image) {
+            if (n_skip > 0) {
+                n_skip--;
+                continue;
+            }
+            if (!decode_image(vctx, seg.image, seq_id, n_past)) {
+                return false;
+            }
+            continue;
+        }
+
+        const size_t skip = std::min(n_skip, seg.tokens.size());
+        n_skip -= skip;
+        if (!decode_tokens(vctx, seg.tokens.data() + skip, seg.tokens.size() - skip,
+                           seq_id, n_past, i + 1 == segments.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void save_prefix(VisionAIContext * vctx, const PrefixCache::Key & key, llama_seq_id seq_id) {
+    const size_t size = llama_state_seq_get_size(vctx->ctx, seq_id);
+    if (size == 0 || size > PREFIX_CACHE_BYTES) {
+        return;
+    }
+    PrefixCache::State state(size);
+    std::unique_lock<std::mutex> lock(vctx->compute_mtx);
+    if (llama_state_seq_get_data(vctx->ctx, state.data(), size, seq_id) != size) {
+        return;
+    }
+    lock.unlock();
+    vctx->prefix_cache.insert(key, std::move(state));
+}
+
+// Prefill a chat-formatted prompt into `seq_id` from scratch, resuming from the longest cached
+// prefix and, if `remember`, caching the resulting KV state for later requests
+static bool eval_prompt(VisionAIContext * vctx, const std::string & formatted,
+                        const std::vector<ImageEmbedding *> & images,
+                        llama_seq_id seq_id, llama_pos & n_past, bool remember = true) {
+    std::vector<PromptSegment> segments;
+    if (!split_prompt(vctx, formatted, images, segments)) {
+        return false;
+    }
+    const PrefixCache::Key key = prompt_key(segments);
+
+    bool exact = false;
+    const size_t n_reused = restore_prefix(vctx, segments, key, seq_id, n_past, exact);
+    if (!eval_segments(vctx, segments, n_reused, seq_id, n_past)) {
+        return false;
+    }
+    if (remember && !exact) {
+        save_prefix(vctx, key, seq_id);
+    }
+
+    const PrefixCache & cache = vctx->prefix_cache;
+    LOGI("  Prefix cache: reused %zu/%zu items | hits: %zu, misses: %zu | %zu KB held",
+         n_reused, key.size(), cache.hits(), cache.misses(), cache.bytes() / 1024);
+    return true;
+}
+
+// Reset the one-shot KV sequence and sampler, then prefill the templated prompt with its images
+static bool prefill(VisionAIContext * vctx, const std::string & prompt,
+                    const std::vector<ImageEmbedding *> & images, GenerationState & gen,
+                    bool remember = true) {
+    std::string formatted = apply_chat_template(vctx->model, build_user_content(prompt, images.size()));
+
+    create_sampler(vctx); // Reset sampler state
+    gen = { vctx->sampler, SEQ_ONESHOT, 0 };
+
+    // Only our own sequence is reset: chat sessions keep theirs across requests
+    return eval_prompt(vctx, formatted, images, gen.seq_id, gen.n_past, remember);
+}
+
+// Helper: run token generation loop, returns response string.
+// Token pieces are also pushed to the request's TokenRing, or failing that, streamed to
+// TokenCallback.onToken when a callback is given.
+static std::string generate_response(VisionAIContext * vctx, GenerationState & gen, int max_tokens,
+                                     JNIEnv * env = nullptr, jobject callback = nullptr) {
+    const llama_vocab * vocab = llama_model_get_vocab(vctx->model);
+    std::string response;
+    int tokens_generated = 0;
+
+    const Request * req = vctx->active;
+    TokenRing * ring = req ? req->ring.get() : nullptr;
+
+    // Cache JNI method IDs for the callback interface
+    jmethodID onTokenMethod = nullptr;
+    if (callback && !ring) {
+        jclass cbClass = env->GetObjectClass(callback);
+        onTokenMethod = env->GetMethodID(cbClass, "onToken", "(Ljava/lang/String;)V");
+    }
+
+    llama_batch batch = llama_batch_init(1, 0, 1);
+    auto t_gen_start = steady_clock::now();
+
+    for (int i = 0; i < max_tokens; i++) {
+        if (is_cancelled(vctx)) {
+            LOGI("Generation cancelled after %d tokens", tokens_generated);
+            break;
+        }
+
+        llama_token token_id = llama_sampler_sample(gen.sampler, vctx->ctx, -1);
+
+        if (llama_vocab_is_eog(vocab, token_id)) {
+            break;
+        }
+
+        // A token counts as generated once it is in the KV cache: one aborted mid-decode is
+        // dropped, so the response always matches the sequence the next turn continues
+        batch.n_tokens     = 1;
+        batch.token[0]     = token_id;
+        batch.pos[0]       = gen.n_past;
+        batch.n_seq_id[0]  = 1;
+        batch.seq_id[0][0] = gen.seq_id;
+        batch.logits[0]    = true;
+        if (decode_batch(vctx, batch) != 0) {
+            if (!is_cancelled(vctx)) {
+                LOGE("Failed to decode token at position %d", i);
+            }
+            break;
+        }
+        gen.n_past++;
+
+        tokens_generated++;
+        gen.generated.push_back(token_id);
+
+        char buf[256];
+        int n = llama_token_to_piece(vocab, token_id, buf, sizeof(buf), 0, true);
+        if (n > 0) {
+            response.append(buf, n);
+
+            if (ring) {
+                ring->push(buf, n);
+            } else if (callback) {
+                // Call Java callback with the token piece
+                jstring jtoken = env->NewStringUTF(std::string(buf, n).c_str());
+                env->CallVoidMethod(callback, onTokenMethod, jtoken);
+                env->DeleteLocalRef(jtoken);
+            }
+        }
+    }
+
+    llama_batch_free(batch);
+
+    auto t_gen_end = steady_clock::now();
+    long long gen_ms = elapsed_ms(t_gen_start, t_gen_end);
+    float tok_s = tokens_generated > 0 && gen_ms > 0 ? (tokens_generated * 1000.0f / gen_ms) : 0;
+    LOGI("  Generation%s: %lld ms (%d tokens, %.1f tok/s)",
+         ring ? " (ring)" : callback ? " (streaming)" : "", gen_ms, tokens_generated, tok_s);
+
+    return response;
+}
+
+static bool acquire_seq(VisionAIContext * vctx, llama_seq_id & seq_id) {
+    for (int i = 0; i < N_SEQ; i++) {
+        if (!vctx->seq_in_use[i]) {
+            vctx->seq_in_use[i] = true;
+            seq_id = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void release_seq(VisionAIContext * vctx, llama_seq_id seq_id) {
+    llama_memory_seq_rm(llama_get_memory(vctx->ctx), seq_id, -1, -1);
+    vctx->seq_in_use[seq_id] = false;
+}
+
+// Text that closes the previous assistant reply and opens the next user turn plus the
+// assistant header, i.e. everything the KV cache is missing for the new question.
+// `n_close` receives the length of the leading part that closes the previous reply.
+static std::string chat_turn_delta(const llama_model * model,
+                                   std::vector<std::pair<std::string, std::string>> & messages,
+                                   const std::string & question, size_t & n_close) {
+    const std::pair<std::string, std::string> last = messages.back();
+    messages.pop_back();
+    const std::string open = format_chat(model, messages, true);
+    messages.push_back(last);
+    const std::string closed = format_chat(model, messages, false);
+    messages.push_back({ "user", question });
+    const std::string next = format_chat(model, messages, true);
+
+    // The KV cache holds the assistant header and the reply as generated; everything the template
+    // renders after the reply's text closes the turn. It is appended whatever the reply, even an
+    // empty one or one the template trims away, so the next turn never follows an open one.
+    std::string delta;
+    if (closed.compare(0, open.size(), open) == 0) {
+        const std::string rest  = closed.substr(open.size());
+        const std::string reply = strip_whitespace(last.second);
+        const size_t reply_at = reply.empty() ? std::string::npos : rest.find(reply);
+        if (reply_at != std::string::npos) {
+            delta = rest.substr(reply_at + reply.size());
+        } else {
+            if (!reply.empty()) {
+                LOGE("Reply not found in the rendered turn, closing after all of it");
+            }
+            delta = rest;
+        }
+    } else {
+        const size_t reply_at = last.second.empty() ? std::string::npos : closed.rfind(last.second);
+        if (reply_at != std::string::npos) {
+            delta = closed.substr(reply_at + last.second.size());
+        } else {
+            LOGE("Chat template re-renders the assistant header, turn left without its terminator");
+        }
+    }
+    n_close = delta.size();
+
+    if (next.compare(0, closed.size(), closed) == 0) {
+        delta += next.substr(closed.size());
+    } else {
+        // Template re-rendered earlier turns differently; fall back to the common prefix
+        size_t common = 0;
+        while (common < closed.size() && common < next.size() && closed[common] == next[common]) {
+            common++;
+        }
+        LOGE("Chat template is not append-only, diverges at char %zu", common);
+        delta += next.substr(common);
+    }
+    return delta;
+}
+
+// Drop the oldest `n_evict` turns from the KV cache and the message list, shifting the later
+// ones down so the sequence stays contiguous after the system prefix. False if it cannot shift.
+static bool drop_turns(ChatSession * session, size_t n_evict) {
+    VisionAIContext * vctx = session->vctx;
+    llama_memory_t mem = llama_get_memory(vctx->ctx);
+    // RoPE positions can only be shifted for 1D positions
+    if (!llama_memory_can_shift(mem) || mtmd_decode_use_mrope(vctx->ctx_mtmd)) {
+        LOGE("KV cache cannot shift, keeping all %zu turns", session->turn_start.size());
+        return false;
+    }
+
+    const llama_pos p0 = session->turn_start[0];
+    const llama_pos p1 = session->turn_start[n_evict];
+    const llama_pos shift = p1 - p0;
+    llama_memory_seq_rm(mem, session->seq_id, p0, p1);
+    llama_memory_seq_add(mem, session->seq_id, p1, -1, -shift);
+
+    session->turn_start.erase(session->turn_start.begin(), session->turn_start.begin() + n_evict);
+    for (llama_pos & start : session->turn_start) {
+        start -= shift;
+    }
+    session->messages.erase(session->messages.begin(), session->messages.begin() + 2 * n_evict);
+    session->n_past -= shift;
+    LOGI("Evicted %zu turn(s), %d positions | Context: %d", n_evict, shift, session->n_past);
+    return true;
+}
+
+// Drop the oldest turns beyond the session's window
+static void evict_turns(ChatSession * session) {
+    if (session->max_turns > 0 && session->turn_start.size() > session->max_turns) {
+        drop_turns(session, session->turn_start.size() - session->max_turns);
+    }
+}
+
+// KV cells held by the live sequences other than `seq_id`. The cache is unified, so all of them
+// draw from the same n_ctx cells. A system prefix copied from SEQ_SYSTEM shares its cells and is
+// counted twice, which errs on the safe side.
+static size_t cells_used_by_others(const VisionAIContext * vctx, llama_seq_id seq_id) {
+    llama_memory_t mem = llama_get_memory(vctx->ctx);
+    size_t n_cells = 0;
+    for (llama_seq_id i = 0; i < N_SEQ; i++) {
+        if (i != seq_id && vctx->seq_in_use[i]) {
+            n_cells += (size_t) (llama_memory_seq_pos_max(mem, i) + 1); // -1 when empty
+        }
+    }
+    return n_cells;
+}
+
+// Whether `n_new_tokens` and a full reply fit next to everything else in the cache. When they
+// do not, the one-shot sequence is cleared first (it is idle during a chat call and the prefix
+// cache keeps host copies of its states), then this session's oldest turns are dropped, always
+// keeping the newest one: the question being asked still has to close it.
+static bool chat_fits(ChatSession * session, size_t n_new_tokens) {
+    VisionAIContext * vctx = session->vctx;
+    const size_t n_ctx = llama_n_ctx(vctx->ctx);
+    size_t n_others = cells_used_by_others(vctx, session->seq_id);
+    auto fits = [&] {
+        return n_others + (size_t) session->n_past + n_new_tokens + (size_t) session->max_reply <= n_ctx;
+    };
+
+    if (!fits() && llama_memory_seq_pos_max(llama_get_memory(vctx->ctx), SEQ_ONESHOT) >= 0) {
+        llama_memory_seq_rm(llama_get_memory(vctx->ctx), SEQ_ONESHOT, -1, -1);
+        n_others = cells_used_by_others(vctx, session->seq_id);
+    }
+    while (!fits() && session->turn_start.size() > 1 && drop_turns(session, 1)) {
+    }
+    if (!fits()) {
+        LOGE("Context full: %zu cells in other sequences, %d in this one, %zu new, %d reserved for the reply",
+             n_others, session->n_past, n_new_tokens, session->max_reply);
+        return false;
+    }
+    return true;
+}
+
+// Rebuild the sampler for the next turn from the session seed, the turn index and the recent
+// reply tokens the repetition penalty looks at
+static void reset_session_sampler(ChatSession * session) {
+    if (session->sampler) {
+        llama_sampler_free(session->sampler);
+    }
+    const uint32_t turn = (uint32_t) (session->messages.size() / 2);
+    session->sampler = make_sampler(session->seed + turn);
+    for (llama_token token : session->recent) {
+        llama_sampler_accept(session->sampler, token);
+    }
+}
+
+static void finish_turn(ChatSession * session, GenerationState & gen, const std::string & response) {
+    session->n_past = gen.n_past;
+    session->messages.push_back({ "assistant", response });
+
+    auto & recent = session->recent;
+    recent.insert(recent.end(), gen.generated.begin(), gen.generated.end());
+    if (recent.size() > PENALTY_LAST_N) {
+        recent.erase(recent.begin(), recent.end() - PENALTY_LAST_N);
+    }
+}
+
+static_assert(sizeof(llama_pos) == sizeof(int32_t) && sizeof(llama_token) == sizeof(int32_t),
+              "session files store positions and tokens as int32_t");
+
+static bool save_session(const ChatSession * session, const std::string & path) {
+    llama_context * ctx = session->vctx->ctx;
+    SessionFile file;
+    file.state.resize(llama_state_seq_get_size(ctx, session->seq_id));
+    std::unique_lock<std::mutex> lock(session->vctx->compute_mtx);
+    const bool saved = !file.state.empty() &&
+            llama_state_seq_get_data(ctx, file.state.data(), file.state.size(), session->seq_id) == file.state.size();
+    lock.unlock();
+    if (!saved) {
+        LOGE("Failed to read KV state of sequence %d", session->seq_id);
+        return false;
+    }
+
+    file.image_hashes = session->image_hashes;
+    file.seed         = session->seed;
+    file.n_past       = session->n_past;
+    file.recent       = session->recent;
+    file.turn_start   = session->turn_start;
+    file.max_turns    = (uint64_t) session->max_turns;
+    file.max_reply    = (int32_t) session->max_reply;
+    file.messages     = session->messages;
+    if (!write_session_file(path, file)) {
+        LOGE("Failed to write session file %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Load a saved session into `session`'s KV sequence. The file must have been saved for
+// `image_hash`; nothing in the session changes unless the whole file is valid.
+static bool restore_session(ChatSession * session, const std::string & path, uint64_t image_hash) {
+    SessionFile file;
+    uint32_t version = 0;
+    switch (read_session_file(path, file, version)) {
+        case SessionReadStatus::OK:
+            break;
+        case SessionReadStatus::MISSING:
+            return false;
+        case SessionReadStatus::WRONG_VERSION:
+            LOGE("Session file %s has version %u, expected %u", path.c_str(), version, SESSION_VERSION);
+            return false;
+        case SessionReadStatus::INVALID:
+            LOGE("Session file %s is invalid", path.c_str());
+            return false;
+    }
+    if (file.image_hashes[0] != image_hash) {
+        LOGE("Session file %s belongs to another image", path.c_str());
+        return false;
+    }
+
+    llama_context * ctx = session->vctx->ctx;
+    llama_memory_seq_rm(llama_get_memory(ctx), session->seq_id, -1, -1);
+    std::unique_lock<std::mutex> lock(session->vctx->compute_mtx);
+    const size_t n_read = llama_state_seq_set_data(ctx, file.state.data(), file.state.size(), session->seq_id);
+    lock.unlock();
+    if (n_read == 0) {
+        LOGE("Session file %s does not match the loaded model", path.c_str());
+        llama_memory_seq_rm(llama_get_memory(ctx), session->seq_id, -1, -1);
+        session->messages.clear();
+        session->n_past = 0;
+        return false;
+    }
+
+    session->n_past       = file.n_past;
+    session->seed         = file.seed;
+    session->recent       = std::move(file.recent);
+    session->messages     = std::move(file.messages);
+    session->image_hashes = std::move(file.image_hashes);
+    session->turn_start   = std::move(file.turn_start);
+    session->max_turns    = (size_t) file.max_turns;
+    session->max_reply    = file.max_reply;
+    return true;
+}
+
+// Frames arrive as direct ByteBuffers of RGBA_8888 pixels (Bitmap.copyPixelsToBuffer), often
+// pooled on the Kotlin side. They are converted into `rgb`, a native scratch buffer, and never
+// written: the caller may still show the frame or hand the buffer back to its pool.
+static bool rgb_from_buffer(JNIEnv * env, jobject buffer, jint width, jint height,
+                            std::vector<unsigned char> & rgb) {
+    const auto * px = static_cast<const unsigned char *>(env->GetDirectBufferAddress(buffer));
+    const size_t n_pixels = (size_t) width * height;
+    if (!px || env->GetDirectBufferCapacity(buffer) < (jlong) (n_pixels * 4)) {
+        LOGE("Frame is not a direct RGBA buffer of %dx%d", width, height);
+        return false;
+    }
+    rgb.resize(n_pixels * 3);
+    rgba_to_rgb(rgb.data(), px, n_pixels);
+    return true;
+}
+
+static ImageEmbedding * encode_image_buffer(JNIEnv * env, VisionAIContext * vctx,
+                                            jobject buffer, jint width, jint height,
+                                            size_t max_tokens = 0) {
+    std::vector<unsigned char> rgb;
+    if (!rgb_from_buffer(env, buffer, width, height, rgb)) {
+        return nullptr;
+    }
+    return encode_image(vctx, rgb.data(), (uint32_t) width, (uint32_t) height, max_tokens);
+}
+
+// Continuous mode as a two-stage pipeline: the capture side drops frames into a latest-wins
+// slot and never waits, while a worker thread encodes and gates them as the caller's thread
+// generates the previous frame's description. With a latency budget (capture to finished
+// description) the worker starts a frame only when its encode would end about when the
+// describe stage frees up, then runs it in full, with a smaller token budget, or drops it for a
+// fresher one. The worker is the only user of the mtmd context while the session runs. On CPU
+// its encoder passes run alongside the caller's decodes; on a GPU shared with the LLM they take
+// turns on VisionAIContext::compute_mtx, and only capture, preprocessing and the change gate
+// overlap with describing.
+struct ContinuousSession {
+    struct Frame {
+        std::vector<unsigned char> rgb;
+        uint32_t width;
+        uint32_t height;
+        jlong id;
+        steady_clock::time_point captured;
+    };
+    // Encoder stage output; `emb` is null when the change gate held the frame back, or when
+    // encoding failed (`ok` false)
+    struct Encoded {
+        ImageEmbedding * emb;
+        bool ok;
+        bool downgraded;
+        jlong id;
+        steady_clock::time_point captured;
+    };
+
+    VisionAIContext * vctx = nullptr;
+    size_t max_tokens = 0;
+    long long budget_ms = 0;    // 0: no deadline, every frame runs in full as soon as possible
+
+    // The worker's own cancellation: vctx->active belongs to whatever the caller's thread runs
+    // next to it, and stopping the session must abort an encode in flight
+    Request worker_request;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::optional<Frame>   pending;   // newest submitted frame the worker has not taken
+    std::optional<Encoded> encoded;   // waiting for the describe stage
+    jlong encoding_id = 0;            // frame the worker is encoding, 0 when idle
+    bool stopping = false;
+    std::thread worker;
+
+    // Description in flight, from continuousNext to continuousComplete
+    bool describing = false;
+    bool describing_downgraded = false;
+    steady_clock::time_point describe_start;
+    steady_clock::time_point describe_captured;
+
+    // Running estimates (ms) the schedule is planned with; 0 until first measured
+    float encode_ms        = 0.0f;
+    float describe_ms      = 0.0f;
+    float describe_down_ms = 0.0f;
+
+    std::vector<float> latencies;     // capture to finished description, ms, newest last
+    uint32_t n_described  = 0;        // all of them, latencies only keeps the last samples
+    uint32_t n_encoded    = 0;
+    uint32_t n_dropped    = 0;
+    uint32_t n_downgraded = 0;
+    steady_clock::time_point t_start = steady_clock::now();
+};
+
+enum class FramePlan { FULL, DOWNGRADE, DROP };
+
+static float ms_between(steady_clock::time_point a, steady_clock::time_point b) {
+    return std::chrono::duration<float, std::milli>(b - a).count();
+}
+
+static void update_estimate(float & estimate, float sample) {
+    estimate = estimate == 0.0f ? sample : estimate + CONTINUOUS_EMA * (sample - estimate);
+}
+
+// Time until the description in flight is expected to finish
+static float describe_wait_ms(const ContinuousSession * cs, steady_clock::time_point now) {
+    if (!cs->describing) {
+        return 0.0f;
+    }
+    const float expected = cs->describing_downgraded && cs->describe_down_ms > 0.0f
+                           ? cs->describe_down_ms : cs->describe_ms;
+    return std::max(0.0f, expected - ms_between(cs->describe_start, now));
+}
+
+// What to do with a frame of age `age_ms` so it is described within the budget
+static FramePlan plan_frame(const ContinuousSession * cs, float age_ms, float wait_ms) {
+    if (cs->budget_ms <= 0 || cs->describe_ms == 0.0f) {
+        return FramePlan::FULL;   // no deadline, or nothing measured to plan with yet
+    }
+    const float ready = std::max(cs->encode_ms, wait_ms);
+    const float down  = cs->describe_down_ms > 0.0f ? cs->describe_down_ms
+                                                    : cs->describe_ms * CONTINUOUS_DOWNGRADE_GUESS;
+    if (age_ms + ready + cs->describe_ms <= cs->budget_ms) {
+        return FramePlan::FULL;
+    }
+    if (age_ms + ready + down <= cs->budget_ms) {
+        return FramePlan::DOWNGRADE;
+    }
+    // Late only because the frame is old: a fresher one can still make it
+    if (ready + down <= cs->budget_ms) {
+        return FramePlan::DROP;
+    }
+    return FramePlan::DOWNGRADE;  // out of reach either way, so at least keep it short
+}
+
+static void continuous_worker(ContinuousSession * cs) {
+    std::unique_lock<std::mutex> lock(cs->mtx);
+    while (true) {
+        // Take a frame once the last encoded one was picked up and, with a budget, once its
+        // encode would end about when the describe stage frees up; until then newer frames
+        // keep replacing the pending one
+        while (!cs->stopping) {
+            const bool due = cs->budget_ms <= 0 ||
+                             describe_wait_ms(cs, steady_clock::now()) <= cs->encode_ms;
+            if (cs->pending && !cs->encoded && due) {
+                break;
+            }
+            cs->cv.wait_for(lock, std::chrono::milliseconds(CONTINUOUS_POLL_MS));
+        }
+        if (cs->stopping) {
+            return;
+        }
+        ContinuousSession::Frame frame = std::move(*cs->pending);
+        cs->pending.reset();
+        cs->encoding_id = frame.id;
+
+        auto t_start = steady_clock::now();
+        const float age = ms_between(frame.captured, t_start);
+        const FramePlan plan = plan_frame(cs, age, describe_wait_ms(cs, t_start));
+        if (plan == FramePlan::DROP) {
+            cs->encoding_id = 0;
+            cs->n_dropped++;
+            LOGI("Frame %lld dropped: %.0f ms old, budget %lld ms", (long long) frame.id, age, cs->budget_ms);
+            continue;
+        }
+        size_t max_tokens = cs->max_tokens;
+        if (plan == FramePlan::DOWNGRADE) {
+            cs->n_downgraded++;
+            max_tokens = max_tokens > 0 ? std::max<size_t>(1, max_tokens / 2) : CONTINUOUS_DOWNGRADE_TOKENS;
+        }
+        lock.unlock();
+
+        ImageEmbedding * emb = encode_image(cs->vctx, frame.rgb.data(), frame.width, frame.height, max_tokens,
+                                            &cs->worker_request);
+        const bool ok = emb != nullptr;
+        if (emb && !scene_changed(cs->vctx, emb, t_start)) {
+            delete emb;
+            emb = nullptr;
+        }
+
+        lock.lock();
+        cs->encoding_id = 0;
+        update_estimate(cs->encode_ms, ms_between(t_start, steady_clock::now()));
+        cs->n_encoded++;
+        if (cs->stopping) {
+            delete emb;
+            return;
+        }
+        cs->encoded = ContinuousSession::Encoded{ emb, ok, plan == FramePlan::DOWNGRADE, frame.id, frame.captured };
+        cs->cv.notify_all();
+    }
+}
+
+// Block until `ready()` holds; false instead if the session stops or the request is cancelled
+template <typename Ready>
+static bool wait_for_stage(ContinuousSession * cs, std::unique_lock<std::mutex> & lock,
+                           const Request * req, Ready ready) {
+    while (!ready()) {
+        if (cs->stopping || (req && req->cancelled)) {
+            return false;
+        }
+        cs->cv.wait_for(lock, std::chrono::milliseconds(CONTINUOUS_POLL_MS));
+    }
+    return true;
+}
+
+// Nearest-rank percentile `p` (0-1) of `values`, 0 when empty
+static float percentile(std::vector<float> values, float p) {
+    if (values.empty()) {
+        return 0.0f;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t rank = (size_t) std::ceil(p * values.size());
+    return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+}
+
+// Encode every frame of a video request; returns false if any frame fails
+// `max_tokens` is the visual token budget of all frames together (0 = no cap)
+static bool encode_frames(JNIEnv * env, VisionAIContext * vctx,
+                          jobjectArray frames_array, jintArray widths, jintArray heights,
+                          size_t max_tokens, std::vector<std::unique_ptr<ImageEmbedding>> & out) {
+    int n_frames = env->GetArrayLength(frames_array);
+    if (n_frames <= 0 || env->GetArrayLength(widths) != n_frames || env->GetArrayLength(heights) != n_frames) {
+        LOGE("Video request with %d frames and %d x %d sizes", n_frames,
+             env->GetArrayLength(widths), env->GetArrayLength(heights));
+        return false;
+    }
+    std::vector<jint> w_arr(n_frames), h_arr(n_frames);
+    env->GetIntArrayRegion(widths, 0, n_frames, w_arr.data());
+    env->GetIntArrayRegion(heights, 0, n_frames, h_arr.data());
+
+    std::vector<std::vector<unsigned char>> rgb(n_frames);
+    for (int i = 0; i < n_frames; i++) {
+        jobject frame = env->GetObjectArrayElement(frames_array, i);
+        LOGI("  Frame %d: %dx%d", i, w_arr[i], h_arr[i]);
+        const bool ok = rgb_from_buffer(env, frame, w_arr[i], h_arr[i], rgb[i]);
+        env->DeleteLocalRef(frame);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    // mtmd has no multi-image encode, so only the preprocessing overlaps: while this frame is
+    // tokenized and encoded, a short-lived std::async thread hashes and resamples the next one.
+    // There is never more than one at a time, on the core the encoder leaves free (see
+    // ENCODE_HELPER_THREADS). Everything that touches the mtmd context stays on this thread.
+    auto t_start = steady_clock::now();
+    auto prepare = [vctx, &rgb, &w_arr, &h_arr](int i) {
+        return std::async(std::launch::async, [vctx, &rgb, &w_arr, &h_arr, i] {
+            return prepare_image(vctx, rgb[i].data(), (uint32_t) w_arr[i], (uint32_t) h_arr[i]);
+        });
+    };
+    std::future<PreparedImage> next = prepare(0);
+
+    // On failure the frame still in flight is joined by its future's destructor
+    const size_t per_frame = max_tokens > 0 ? std::max<size_t>(1, max_tokens / n_frames) : 0;
+    bool ok = true;
+    for (int i = 0; i < n_frames && ok; i++) {
+        const PreparedImage img = next.get();
+        if (i + 1 < n_frames) {
+            next = prepare(i + 1);
+        }
+        std::unique_ptr<ImageEmbedding> emb(tokenize_prepared(vctx, img));
+        ok = emb && encode_chunks(vctx, emb.get(), per_frame);
+        if (ok) {
+            out.push_back(std::move(emb));
+        }
+    }
+
+    LOGI("Encoded %d frames in %lld ms (preprocessing overlapped)", n_frames,
+         elapsed_ms(t_start, steady_clock::now()));
+    return ok;
+}
+
+static std::vector<ImageEmbedding *> as_images(const std::vector<std::unique_ptr<ImageEmbedding>> & owned) {
+    std::vector<ImageEmbedding *> images;
+    for (const auto & emb : owned) {
+        images.push_back(emb.get());
+    }
+    return images;
+}
+
+// Resolve a Java long[] of ImageEmbedding handles; false if any was already released
+static bool images_from_handles(JNIEnv * env, jlongArray embd_ptrs, std::vector<ImageEmbedding *> & images) {
+    int n_images = env->GetArrayLength(embd_ptrs);
+    std::vector<jlong> ptrs(n_images);
+    env->GetLongArrayRegion(embd_ptrs, 0, n_images, ptrs.data());
+
+    for (jlong ptr : ptrs) {
+        auto * emb = reinterpret_cast<ImageEmbedding *>(ptr);
+        if (!emb) {
+            return false;
+        }
+        images.push_back(emb);
+    }
+    return true;
+}
+
+// Long video summarized hierarchically: each segment is captioned on its own, the one-shot
+// sequence starting over every time, and each `group` entries of a level are folded into one
+// summary on the level above. The clip's length only adds levels, so the captions held stay
+// O(group x levels) and the final summary always fits one context.
+struct LongVideoSession {
+    struct Caption {
+        long long   start_ms;
+        long long   end_ms;
+        std::string text;
+    };
+
+    VisionAIContext * vctx = nullptr;
+    std::string summary_prompt;
+    size_t group = LONG_VIDEO_GROUP;
+    // levels[0] holds segment captions; every entry of a level is older than those below it
+    std::vector<std::vector<Caption>> levels;
+
+    size_t    n_segments = 0;
+    size_t    n_folds    = 0;
+    long long encode_ms  = 0;
+    long long caption_ms = 0;
+    long long fold_ms    = 0;
+    steady_clock::time_point t_start = steady_clock::now();
+};
+
+static std::string format_timestamp(long long ms) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld:%02lld", ms / 60000, ms / 1000 % 60);
+    return buf;
+}
+
+// The session's summary prompt over `captions`, one timestamped line each
+static std::string captions_prompt(const LongVideoSession * lv,
+                                   const std::vector<LongVideoSession::Caption> & captions) {
+    std::string prompt = lv->summary_prompt + "\n";
+    for (const auto & caption : captions) {
+        prompt += "\n[" + format_timestamp(caption.start_ms) + "-" + format_timestamp(caption.end_ms) + "] " +
+                  caption.text;
+    }
+    return prompt;
+}
+
+// Every entry still held, oldest first
+static std::vector<LongVideoSession::Caption> held_captions(const LongVideoSession * lv) {
+    std::vector<LongVideoSession::Caption> captions;
+    for (size_t level = lv->levels.size(); level-- > 0; ) {
+        captions.insert(captions.end(), lv->levels[level].begin(), lv->levels[level].end());
+    }
+    return captions;
+}
+
+static bool summary_fits(const LongVideoSession * lv, const std::vector<LongVideoSession::Caption> & captions) {
+    VisionAIContext * vctx = lv->vctx;
+    const std::string formatted = format_chat(vctx->model, { { "user", build_user_content(captions_prompt(lv, captions), 0) } }, true);
+    const size_t n_tokens = tokenize_text(llama_model_get_vocab(vctx->model), formatted).size();
+    return cells_used_by_others(vctx, SEQ_ONESHOT) + n_tokens + MAX_TOKENS <= llama_n_ctx(vctx->ctx);
+}
+
+// Fold every entry of `level` into one entry on the level above
+static bool fold_level(LongVideoSession * lv, size_t level) {
+    VisionAIContext * vctx = lv->vctx;
+    auto t_start = steady_clock::now();
+    std::vector<LongVideoSession::Caption> & entries = lv->levels[level];
+
+    GenerationState gen;
+    if (!prefill(vctx, captions_prompt(lv, entries), {}, gen, false)) {
+        return false;
+    }
+    std::string summary = strip_whitespace(generate_response(vctx, gen, LONG_VIDEO_CAPTION_TOKENS));
+    if (is_cancelled(vctx)) {
+        return false;
+    }
+
+    LongVideoSession::Caption folded = { entries.front().start_ms, entries.back().end_ms, std::move(summary) };
+    entries.clear();
+    if (lv->levels.size() == level + 1) {
+        lv->levels.emplace_back();
+    }
+    lv->levels[level + 1].push_back(std::move(folded));
+    lv->n_folds++;
+    lv->fold_ms += elapsed_ms(t_start, steady_clock::now());
+    return true;
+}
+
+// Fold full levels upward, then keep folding the lowest level with more than one entry until
+// the final pass fits in the context
+static bool fold_captions(LongVideoSession * lv) {
+    for (size_t level = 0; level < lv->levels.size(); level++) {
+        if (lv->levels[level].size() >= lv->group && !fold_level(lv, level)) {
+            return false;
+        }
+    }
+    while (!summary_fits(lv, held_captions(lv))) {
+        size_t level = 0;
+        while (level < lv->levels.size() && lv->levels[level].size() < 2) {
+            level++;
+        }
+        if (level == lv->levels.size()) {
+            LOGE("Long video summary does not fit in the context even fully folded");
+            return false;
+        }
+        if (!fold_level(lv, level)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_loaded(const VisionAIContext * vctx) {
+    return vctx && vctx->model && vctx->ctx && vctx->ctx_mtmd;
+}
+
+extern "C" {
+
+// Load the LLM model + multimodal projector
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_loadModel(
+        JNIEnv * env, jobject /* thiz */,
+        jstring model_path, jstring mmproj_path,
+        jint n_threads, jint n_ctx) {
+
+    const char * model_path_c  = env->GetStringUTFChars(model_path, nullptr);
+    const char * mmproj_path_c = env->GetStringUTFChars(mmproj_path, nullptr);
+
+    auto * vctx = new VisionAIContext();
+    vctx->n_threads = n_threads;
+
+    LOGI("Loading model: %s", model_path_c);
+    LOGI("Loading mmproj: %s", mmproj_path_c);
+
+    ggml_backend_load_all();
+
+    // Log available backends
+    size_t n_backends = ggml_backend_dev_count();
+    LOGI("Available backends: %zu", n_backends);
+    for (size_t i = 0; i < n_backends; i++) {
+        ggml_backend_dev_t dev = ggml_backend_dev_get(i);
+        LOGI("  Backend %zu: %s (%s)", i, ggml_backend_dev_name(dev), ggml_backend_dev_description(dev));
+        // The model and the encoder (use_gpu) both take the GPU when there is one
+        const enum ggml_backend_dev_type type = ggml_backend_dev_type(dev);
+        if (type == GGML_BACKEND_DEVICE_TYPE_GPU || type == GGML_BACKEND_DEVICE_TYPE_IGPU) {
+            vctx->encoder_shares_gpu = true;
+        }
+    }
+
+    llama_model_params model_params = llama_model_default_params();
+    model_params.n_gpu_layers = 99; // Offload all layers to GPU (OpenCL/Adreno)
+    vctx->model = llama_model_load_from_file(model_path_c, model_params);
+
+    if (!vctx->model) {
+        LOGE("Failed to load model");
+        env->ReleaseStringUTFChars(model_path, model_path_c);
+        env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
+        delete vctx;
+        throw_java_exception(env, "Failed to load model");
+        return 0;
+    }
+
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx            = n_ctx;
+    ctx_params.n_batch          = 512;  // Larger batches for faster prompt eval
+    ctx_params.n_threads        = n_threads;
+    ctx_params.flash_attn_type  = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+    ctx_params.n_seq_max        = N_SEQ;
+    ctx_params.kv_unified       = true; // Sequences share all n_ctx cells instead of n_ctx / N_SEQ each
+    vctx->ctx = llama_init_from_model(vctx->model, ctx_params);
+
+    if (!vctx->ctx) {
+        LOGE("Failed to create llama context");
+        llama_model_free(vctx->model);
+        env->ReleaseStringUTFChars(model_path, model_path_c);
+        env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
+        delete vctx;
+        throw_java_exception(env, "Failed to create llama context");
+        return 0;
+    }
+
+    mtmd_context_params mparams = mtmd_context_params_default();
+    mparams.use_gpu   = true; // Use GPU (OpenCL/Adreno) for vision encoder too
+    mparams.n_threads = std::max(1, n_threads - ENCODE_HELPER_THREADS);
+
+    vctx->ctx_mtmd = mtmd_init_from_file(mmproj_path_c, vctx->model, mparams);
+
+    if (!vctx->ctx_mtmd) {
+        LOGE("Failed to load multimodal projector");
+        llama_free(vctx->ctx);
+        llama_model_free(vctx->model);
+        env->ReleaseStringUTFChars(model_path, model_path_c);
+        env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
+        delete vctx;
+        throw_java_exception(env, "Failed to load multimodal projector");
+        return 0;
+    }
+
+    read_encoder_geometry(vctx, mmproj_path_c);
+    llama_set_abort_callback(vctx->ctx, abort_requested, vctx);
+
+    create_sampler(vctx);
+    prefill_system_prompt(vctx);
+
+    env->ReleaseStringUTFChars(model_path, model_path_c);
+    env->ReleaseStringUTFChars(mmproj_path, mmproj_path_c);
+
+    const char * chat_tmpl = llama_model_chat_template(vctx->model, nullptr);
+    LOGI("Model loaded successfully, vision support: %s, chat template: %s",
+         mtmd_support_vision(vctx->ctx_mtmd) ? "yes" : "no",
+         chat_tmpl ? "yes" : "no");
+
+    return reinterpret_cast<jlong>(vctx);
+}
+
+// Single image inference
+JNIEXPORT jstring JNICALL
+Java_com_example_visionai_inference_LlamaModel_runInference(
+        JNIEnv * env, jobject /* thiz */,
+        jlong ctx_ptr, jlong request_ptr, jobject image_buffer, jint width, jint height,
+        jstring prompt, jint max_visual_tokens) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return env->NewStringUTF("");
+    }
+
+    ActiveRequest active(vctx, request_ptr);
+
+    LOGI("Running inference: %dx%d image", width, height);
+    auto t_start = steady_clock::now();
+
+    std::unique_ptr<ImageEmbedding> emb(encode_image_buffer(env, vctx, image_buffer, width, height,
+                                                            (size_t) std::max(0, max_visual_tokens)));
+    if (!emb) {
+        throw_java_exception(env, "Failed to encode image");
+        return env->NewStringUTF("");
+    }
+
+    auto t_after_encode = steady_clock::now();
+
+    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
+    GenerationState gen;
+    report_visual_tokens(vctx, { emb.get() });
+    bool ok = prefill(vctx, prompt_c, { emb.get() }, gen);
+    env->ReleaseStringUTFChars(prompt, prompt_c);
 
-    mtmd_input_chunks_free(chunks);
-    mtmd_bitmap_free(bmp);
-    env->ReleaseByteArrayElements(image_bytes, img_data, JNI_ABORT);
+    if (!ok) {
+        throw_java_exception(env, "Failed to evaluate input");
+        return env->NewStringUTF("");
+    }
+
+    auto t_after_eval = steady_clock::now();
+
+    std::string response = generate_response(vctx, gen, MAX_TOKENS);
+
+    auto t_end = steady_clock::now();
+    LOGI("=== PHOTO BENCHMARK === Encode: %lld ms | Eval: %lld ms | Total: %lld ms",
+         elapsed_ms(t_start, t_after_encode), elapsed_ms(t_after_encode, t_after_eval), elapsed_ms(t_start, t_end));
+
+    return env->NewStringUTF(response.c_str());
+}
+
+// Multi-frame video inference
+JNIEXPORT jstring JNICALL
+Java_com_example_visionai_inference_LlamaModel_runVideoInference(
+        JNIEnv * env, jobject /* thiz */,
+        jlong ctx_ptr, jlong request_ptr, jobjectArray frames_array, jintArray widths, jintArray heights,
+        jstring prompt, jint max_visual_tokens) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return env->NewStringUTF("");
+    }
+
+    ActiveRequest active(vctx, request_ptr);
+
+    int n_frames = env->GetArrayLength(frames_array);
+    LOGI("Running video inference: %d frames", n_frames);
+    auto t_start = steady_clock::now();
+
+    std::vector<std::unique_ptr<ImageEmbedding>> frames;
+    if (!encode_frames(env, vctx, frames_array, widths, heights, (size_t) std::max(0, max_visual_tokens), frames)) {
+        throw_java_exception(env, "Failed to encode video input");
+        return env->NewStringUTF("");
+    }
+
+    auto t_after_encode = steady_clock::now();
+
+    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
+    GenerationState gen;
+    report_visual_tokens(vctx, as_images(frames));
+    bool ok = prefill(vctx, prompt_c, as_images(frames), gen);
+    env->ReleaseStringUTFChars(prompt, prompt_c);
+
+    if (!ok) {
+        throw_java_exception(env, "Failed to evaluate video input");
+        return env->NewStringUTF("");
+    }
+
+    auto t_after_eval = steady_clock::now();
+
+    std::string response = generate_response(vctx, gen, MAX_TOKENS);
+
+    auto t_end = steady_clock::now();
+    LOGI("=== VIDEO BENCHMARK === Frames: %d | Encode: %lld ms | Eval: %lld ms | Total: %lld ms",
+         n_frames, elapsed_ms(t_start, t_after_encode), elapsed_ms(t_after_encode, t_after_eval),
+         elapsed_ms(t_start, t_end));
+
+    return env->NewStringUTF(response.c_str());
+}
+
+// Start a long-video summary whose entries are folded `group` at a time (0 = the default), with
+// `summary_prompt` instructing both the folds and the final pass
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_longVideoStart(
+        JNIEnv * env, jobject /* thiz */, jlong ctx_ptr, jint group, jstring summary_prompt) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return 0;
+    }
+
+    auto * lv = new LongVideoSession();
+    lv->vctx  = vctx;
+    lv->group = group > 1 ? (size_t) group : LONG_VIDEO_GROUP;
+    const char * prompt_c = env->GetStringUTFChars(summary_prompt, nullptr);
+    lv->summary_prompt = prompt_c;
+    env->ReleaseStringUTFChars(summary_prompt, prompt_c);
+    lv->levels.emplace_back();
+    return reinterpret_cast<jlong>(lv);
+}
+
+// Caption the segment [start_ms, end_ms) of a long video from its frames, which are freed as soon
+// as they are in the KV cache, and fold the captions held so far. Returns the caption.
+JNIEXPORT jstring JNICALL
+Java_com_example_visionai_inference_LlamaModel_longVideoAddSegment(
+        JNIEnv * env, jobject /* thiz */,
+        jlong session_ptr, jlong request_ptr, jobjectArray frames_array, jintArray widths, jintArray heights,
+        jlong start_ms, jlong end_ms, jstring prompt, jint max_visual_tokens) {
+
+    auto * lv = reinterpret_cast<LongVideoSession *>(session_ptr);
+    if (!lv) {
+        throw_java_exception(env, "Long video session was released");
+        return env->NewStringUTF("");
+    }
+    VisionAIContext * vctx = lv->vctx;
+    ActiveRequest active(vctx, request_ptr);
+
+    auto t_start = steady_clock::now();
+    std::string caption;
+    {
+        std::vector<std::unique_ptr<ImageEmbedding>> frames;
+        if (!encode_frames(env, vctx, frames_array, widths, heights, (size_t) std::max(0, max_visual_tokens), frames)) {
+            throw_java_exception(env, "Failed to encode video input");
+            return env->NewStringUTF("");
+        }
+        lv->encode_ms += elapsed_ms(t_start, steady_clock::now());
+
+        // Segments never repeat, so their states are not worth a place in the prefix cache
+        const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
+        GenerationState gen;
+        report_visual_tokens(vctx, as_images(frames));
+        bool ok = prefill(vctx, prompt_c, as_images(frames), gen, false);
+        env->ReleaseStringUTFChars(prompt, prompt_c);
+        if (!ok) {
+            throw_java_exception(env, "Failed to evaluate video input");
+            return env->NewStringUTF("");
+        }
+        caption = strip_whitespace(generate_response(vctx, gen, LONG_VIDEO_CAPTION_TOKENS));
+    }
+    auto t_after_caption = steady_clock::now();
+    if (is_cancelled(vctx)) {
+        return env->NewStringUTF("");
+    }
+    lv->caption_ms += elapsed_ms(t_start, t_after_caption);
+
+    lv->levels[0].push_back({ start_ms, end_ms, caption });
+    lv->n_segments++;
+    if (!fold_captions(lv) && !is_cancelled(vctx)) {
+        throw_java_exception(env, "Failed to fold segment captions");
+        return env->NewStringUTF("");
+    }
+
+    LOGI("Segment %zu [%s-%s]: %lld ms | Folding: %lld ms | Levels: %zu | Held: %zu entries",
+         lv->n_segments, format_timestamp(start_ms).c_str(), format_timestamp(end_ms).c_str(),
+         elapsed_ms(t_start, t_after_caption), elapsed_ms(t_after_caption, steady_clock::now()),
+         lv->levels.size(), held_captions(lv).size());
+    return env->NewStringUTF(caption.c_str());
+}
+
+// Final pass: stream a summary of everything the session still holds
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_longVideoSummarize(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr, jlong request_ptr, jobject callback) {
+
+    auto * lv = reinterpret_cast<LongVideoSession *>(session_ptr);
+    if (!lv || lv->n_segments == 0) {
+        callback_error(env, callback, "No segments were described");
+        return;
+    }
+    VisionAIContext * vctx = lv->vctx;
+    ActiveRequest active(vctx, request_ptr);
+
+    auto t_start = steady_clock::now();
+    const std::vector<LongVideoSession::Caption> captions = held_captions(lv);
+    GenerationState gen;
+    if (!prefill(vctx, captions_prompt(lv, captions), {}, gen, false)) {
+        callback_error(env, callback, "Failed to evaluate summary");
+        return;
+    }
+    std::string response = generate_response(vctx, gen, MAX_TOKENS, env, callback);
+
+    const long long video_ms = captions.back().end_ms;
+    const long long total_ms = elapsed_ms(lv->t_start, steady_clock::now());
+    LOGI("=== LONG VIDEO BENCHMARK === Segments: %zu | Folds: %zu | Levels: %zu | Encode: %lld ms | "
+         "Captions: %lld ms | Folding: %lld ms | Summary: %lld ms | Total: %lld ms (%.2f s per video second)",
+         lv->n_segments, lv->n_folds, lv->levels.size(), lv->encode_ms, lv->caption_ms, lv->fold_ms,
+         elapsed_ms(t_start, steady_clock::now()), total_ms,
+         video_ms > 0 ? (double) total_ms / video_ms : 0.0);
+
+    callback_complete(env, callback, response);
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_longVideoFree(
+        JNIEnv * /* env */, jobject /* thiz */, jlong session_ptr) {
+    delete reinterpret_cast<LongVideoSession *>(session_ptr);
+}
+
+// Single image inference — streaming version
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_runInferenceStreaming(
+        JNIEnv * env, jobject /* thiz */,
+        jlong ctx_ptr, jlong request_ptr, jobject image_buffer, jint width, jint height,
+        jstring prompt, jint max_visual_tokens, jobject callback) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return;
+    }
+
+    ActiveRequest active(vctx, request_ptr);
+
+    LOGI("Running streaming inference: %dx%d image", width, height);
+    auto t_start = steady_clock::now();
+
+    std::unique_ptr<ImageEmbedding> emb(encode_image_buffer(env, vctx, image_buffer, width, height,
+                                                            (size_t) std::max(0, max_visual_tokens)));
+    if (!emb) {
+        callback_error(env, callback, "Failed to encode image");
+        return;
+    }
+
+    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
+    GenerationState gen;
+    report_visual_tokens(vctx, { emb.get() });
+    bool ok = prefill(vctx, prompt_c, { emb.get() }, gen);
+    env->ReleaseStringUTFChars(prompt, prompt_c);
+
+    if (!ok) {
+        callback_error(env, callback, "Failed to evaluate input");
+        return;
+    }
+
+    std::string response = generate_response(vctx, gen, MAX_TOKENS, env, callback);
+
+    auto t_end = steady_clock::now();
+    LOGI("=== PHOTO STREAMING BENCHMARK === Total: %lld ms", elapsed_ms(t_start, t_end));
+
+    callback_complete(env, callback, response);
+}
+
+// Multi-frame video inference — streaming version
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_runVideoInferenceStreaming(
+        JNIEnv * env, jobject /* thiz */,
+        jlong ctx_ptr, jlong request_ptr, jobjectArray frames_array, jintArray widths, jintArray heights,
+        jstring prompt, jint max_visual_tokens, jobject callback) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return;
+    }
+
+    ActiveRequest active(vctx, request_ptr);
+
+    int n_frames = env->GetArrayLength(frames_array);
+    LOGI("Running streaming video inference: %d frames", n_frames);
+    auto t_start = steady_clock::now();
+
+    std::vector<std::unique_ptr<ImageEmbedding>> frames;
+    if (!encode_frames(env, vctx, frames_array, widths, heights, (size_t) std::max(0, max_visual_tokens), frames)) {
+        callback_error(env, callback, "Failed to encode video input");
+        return;
+    }
+
+    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
+    GenerationState gen;
+    report_visual_tokens(vctx, as_images(frames));
+    bool ok = prefill(vctx, prompt_c, as_images(frames), gen);
+    env->ReleaseStringUTFChars(prompt, prompt_c);
+
+    if (!ok) {
+        callback_error(env, callback, "Failed to evaluate video input");
+        return;
+    }
+
+    std::string response = generate_response(vctx, gen, MAX_TOKENS, env, callback);
+
+    auto t_end = steady_clock::now();
+    LOGI("=== VIDEO STREAMING BENCHMARK === Frames: %d | Total: %lld ms", n_frames, elapsed_ms(t_start, t_end));
+
+    callback_complete(env, callback, response);
+}
+
+// Run the vision encoder once and return a handle to the projected embeddings
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_encodeImage(
+        JNIEnv * env, jobject /* thiz */,
+        jlong ctx_ptr, jlong request_ptr, jobject image_buffer, jint width, jint height) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return 0;
+    }
+
+    ActiveRequest active(vctx, request_ptr);
+
+    auto t_start = steady_clock::now();
+    std::vector<unsigned char> rgb;
+    const bool converted = rgb_from_buffer(env, image_buffer, width, height, rgb);
+    auto t_after_convert = steady_clock::now();
+
+    ImageEmbedding * emb = converted ? encode_image(vctx, rgb.data(), (uint32_t) width, (uint32_t) height) : nullptr;
+    if (!emb) {
+        throw_java_exception(env, "Failed to encode image");
+        return 0;
+    }
+
+    LOGI("=== ENCODE BENCHMARK === %dx%d image -> %zu tokens | RGBA->RGB: %lld us | Total: %lld ms",
+         width, height, emb->n_tokens,
+         (long long) std::chrono::duration_cast<std::chrono::microseconds>(t_after_convert - t_start).count(),
+         elapsed_ms(t_start, steady_clock::now()));
+    return reinterpret_cast<jlong>(emb);
+}
+
+// Continuous-mode gate: encode a frame and compare its pooled embedding with the last frame let
+// through. Returns the embedding handle when the scene changed (the frame becomes the new
+// reference), or 0 when it did not, in which case the LLM need not run at all.
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_gateFrame(
+        JNIEnv * env, jobject /* thiz */,
+        jlong ctx_ptr, jlong request_ptr, jobject image_buffer, jint width, jint height,
+        jint max_visual_tokens) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return 0;
+    }
+
+    ActiveRequest active(vctx, request_ptr);
+
+    auto t_start = steady_clock::now();
+    ImageEmbedding * emb = encode_image_buffer(env, vctx, image_buffer, width, height,
+                                               (size_t) std::max(0, max_visual_tokens));
+    if (!emb) {
+        throw_java_exception(env, "Failed to encode image");
+        return 0;
+    }
+
+    if (!scene_changed(vctx, emb, t_start)) {
+        delete emb;
+        return 0;
+    }
+    report_visual_tokens(vctx, { emb });
+    return reinterpret_cast<jlong>(emb);
+}
+
+// Start a continuous pipeline whose encoder stage runs on its own thread, aiming to finish each
+// description within `budget_ms` of its capture (0 = no deadline). Until it is stopped, the
+// context must not encode images through any other call.
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_continuousStart(
+        JNIEnv * env, jobject /* thiz */, jlong ctx_ptr, jint max_visual_tokens, jint budget_ms) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return 0;
+    }
+
+    auto * cs = new ContinuousSession();
+    cs->vctx       = vctx;
+    cs->max_tokens = (size_t) std::max(0, max_visual_tokens);
+    cs->budget_ms  = std::max(0, budget_ms);
+    cs->worker     = std::thread(continuous_worker, cs);
+    LOGI("Continuous pipeline started, latency budget %lld ms", cs->budget_ms);
+    return reinterpret_cast<jlong>(cs);
+}
+
+// Put a frame in the latest-wins slot, replacing one the worker has not taken yet. Never waits
+// on inference. `captured_ns` is System.nanoTime() at capture (CLOCK_MONOTONIC, as steady_clock).
+// Returns the oldest frame id still in the pipeline: every lower one was replaced, dropped or
+// delivered, so the caller can let go of it. 0 if the frame was not queued.
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_continuousSubmit(
+        JNIEnv * env, jobject /* thiz */,
+        jlong session_ptr, jobject image_buffer, jint width, jint height,
+        jlong frame_id, jlong captured_ns) {
+
+    auto * cs = reinterpret_cast<ContinuousSession *>(session_ptr);
+    // Converted straight into the frame, so the caller can recycle its buffer while it waits
+    ContinuousSession::Frame frame;
+    if (!cs || !rgb_from_buffer(env, image_buffer, width, height, frame.rgb)) {
+        return 0;
+    }
+    frame.width    = (uint32_t) width;
+    frame.height   = (uint32_t) height;
+    frame.id       = frame_id;
+    frame.captured = steady_clock::time_point(std::chrono::duration_cast<steady_clock::duration>(
+            std::chrono::nanoseconds(captured_ns)));
+
+    std::lock_guard<std::mutex> lock(cs->mtx);
+    if (cs->stopping) {
+        return 0;
+    }
+    if (cs->pending) {
+        cs->n_dropped++;
+    }
+    cs->pending = std::move(frame);
+    cs->cv.notify_all();
+
+    jlong oldest = frame_id;
+    if (cs->encoding_id != 0) {
+        oldest = std::min(oldest, cs->encoding_id);
+    }
+    if (cs->encoded) {
+        oldest = std::min(oldest, cs->encoded->id);
+    }
+    return oldest;
+}
+
+// Next encoded frame, blocking until the encoder stage delivers one. Returns its embedding
+// handle, or 0 when the change gate held it back (or on cancel); `info` receives { frame id }.
+// A returned embedding counts as being described until continuousComplete.
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_continuousNext(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr, jlong request_ptr, jlongArray info) {
+
+    auto * cs = reinterpret_cast<ContinuousSession *>(session_ptr);
+    if (!cs) {
+        throw_java_exception(env, "Continuous session was released");
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(cs->mtx);
+    const auto * req = reinterpret_cast<const Request *>(request_ptr);
+    if (!wait_for_stage(cs, lock, req, [cs] { return cs->encoded.has_value(); })) {
+        return 0;
+    }
+    ContinuousSession::Encoded item = *cs->encoded;
+    cs->encoded.reset();
+    if (item.emb) {
+        cs->describing            = true;
+        cs->describing_downgraded = item.downgraded;
+        cs->describe_start        = steady_clock::now();
+        cs->describe_captured     = item.captured;
+    }
+    cs->cv.notify_all(); // the worker may be waiting to start the next one
+    lock.unlock();
+
+    const jlong id = item.id;
+    env->SetLongArrayRegion(info, 0, 1, &id);
+    if (!item.ok) {
+        throw_java_exception(env, "Failed to encode image");
+        return 0;
+    }
+    return reinterpret_cast<jlong>(item.emb);
+}
+
+// The describe stage is done with the frame last returned by continuousNext (speech included),
+// its description having been shown at `described_ns` (System.nanoTime()): record its latency
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_continuousComplete(
+        JNIEnv * /* env */, jobject /* thiz */, jlong session_ptr, jlong described_ns) {
+
+    auto * cs = reinterpret_cast<ContinuousSession *>(session_ptr);
+    if (!cs) return;
+
+    std::lock_guard<std::mutex> lock(cs->mtx);
+    if (!cs->describing) return;
+    const auto now = steady_clock::now();
+    update_estimate(cs->describing_downgraded ? cs->describe_down_ms : cs->describe_ms,
+                    ms_between(cs->describe_start, now));
+    const auto described = steady_clock::time_point(std::chrono::duration_cast<steady_clock::duration>(
+            std::chrono::nanoseconds(described_ns)));
+    const float latency = ms_between(cs->describe_captured, std::min(described, now));
+    cs->n_described++;
+    cs->latencies.push_back(latency);
+    if (cs->latencies.size() > CONTINUOUS_LATENCY_SAMPLES) {
+        cs->latencies.erase(cs->latencies.begin());
+    }
+    cs->describing = false;
+    cs->cv.notify_all();
+    LOGI("Frame latency: %.0f ms%s | budget %lld ms", latency,
+         cs->describing_downgraded ? " (downgraded)" : "", cs->budget_ms);
+}
+
+// { p50, p90, p99 latency ms over recent frames, then frames described, dropped, downgraded }
+JNIEXPORT jfloatArray JNICALL
+Java_com_example_visionai_inference_LlamaModel_continuousStats(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr) {
+
+    auto * cs = reinterpret_cast<ContinuousSession *>(session_ptr);
+    jfloat stats[6] = {};
+    if (cs) {
+        std::lock_guard<std::mutex> lock(cs->mtx);
+        stats[0] = percentile(cs->latencies, 0.50f);
+        stats[1] = percentile(cs->latencies, 0.90f);
+        stats[2] = percentile(cs->latencies, 0.99f);
+        stats[3] = (jfloat) cs->n_described;
+        stats[4] = (jfloat) cs->n_dropped;
+        stats[5] = (jfloat) cs->n_downgraded;
+    }
+    jfloatArray result = env->NewFloatArray(6);
+    env->SetFloatArrayRegion(result, 0, 6, stats);
+    return result;
+}
+
+// Stop the encoder thread and drop what is still queued. Calls blocked in continuousNext must
+// have returned first.
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_continuousStop(
+        JNIEnv * /* env */, jobject /* thiz */, jlong session_ptr) {
+
+    auto * cs = reinterpret_cast<ContinuousSession *>(session_ptr);
+    if (!cs) return;
+
+    {
+        std::lock_guard<std::mutex> lock(cs->mtx);
+        cs->stopping = true;
+    }
+    cs->worker_request.cancelled = true;
+    cs->cv.notify_all();
+    cs->worker.join();
+    if (cs->encoded) {
+        delete cs->encoded->emb;
+    }
+
+    const long long total_ms = elapsed_ms(cs->t_start, steady_clock::now());
+    LOGI("=== CONTINUOUS PIPELINE BENCHMARK === Encoded: %u | Described: %u | Dropped: %u | Downgraded: %u | "
+         "Latency p50/p90/p99: %.0f/%.0f/%.0f ms (budget %lld) | %.1f frames/min",
+         cs->n_encoded, cs->n_described, cs->n_dropped, cs->n_downgraded,
+         percentile(cs->latencies, 0.50f), percentile(cs->latencies, 0.90f), percentile(cs->latencies, 0.99f),
+         cs->budget_ms, total_ms > 0 ? cs->n_described * 60000.0 / total_ms : 0.0);
+    delete cs;
+}
+
+// Streaming inference over previously encoded images — skips the vision encoder
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_runEmbeddingInferenceStreaming(
+        JNIEnv * env, jobject /* thiz */,
+        jlong ctx_ptr, jlong request_ptr, jlongArray embd_ptrs, jstring prompt, jobject callback) {
+
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!is_loaded(vctx)) {
+        throw_java_exception(env, "Model not loaded");
+        return;
+    }
+
+    ActiveRequest active(vctx, request_ptr);
+
+    std::vector<ImageEmbedding *> images;
+    if (!images_from_handles(env, embd_ptrs, images)) {
+        callback_error(env, callback, "Image embedding was released");
+        return;
+    }
+    int n_images = (int) images.size();
+
+    LOGI("Running streaming inference on %d encoded image(s)", n_images);
+    auto t_start = steady_clock::now();
+
+    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
+    GenerationState gen;
+    report_visual_tokens(vctx, images);
+    bool ok = prefill(vctx, prompt_c, images, gen);
     env->ReleaseStringUTFChars(prompt, prompt_c);
 
-    return env->NewStringUTF(response.c_str());
+    if (!ok) {
+        callback_error(env, callback, "Failed to evaluate input");
+        return;
+    }
+
+    auto t_after_eval = steady_clock::now();
+
+    std::string response = generate_response(vctx, gen, MAX_TOKENS, env, callback);
+
+    auto t_end = steady_clock::now();
+    LOGI("=== EMBEDDING STREAMING BENCHMARK === Images: %d | Eval: %lld ms | Total: %lld ms",
+         n_images, elapsed_ms(t_start, t_after_eval), elapsed_ms(t_start, t_end));
+
+    callback_complete(env, callback, response);
 }
 
-// Multi-frame video inference
-JNIEXPORT jstring JNICALL
-Java_com_example_visionai_inference_LlamaModel_runVideoInference(
-        JNIEnv * env, jobject /* thiz */,
-        jlong ctx_ptr, jobjectArray frames_array, jintArray widths, jintArray heights,
-        jstring prompt) {
+// Create an empty chat session bound to its own KV sequence; 0 if all sequences are taken
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_createChatSession(
+        JNIEnv * env, jobject /* thiz */, jlong ctx_ptr) {
 
     auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
-    if (!vctx || !vctx->model || !vctx->ctx || !vctx->ctx_mtmd) {
+    if (!is_loaded(vctx)) {
         throw_java_exception(env, "Model not loaded");
-        return env->NewStringUTF("");
+        return 0;
     }
 
-    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
-    int n_frames = env->GetArrayLength(frames_array);
-    jint * w_arr = env->GetIntArrayElements(widths, nullptr);
-    jint * h_arr = env->GetIntArrayElements(heights, nullptr);
+    llama_seq_id seq_id;
+    if (!acquire_seq(vctx, seq_id)) {
+        LOGE("No free KV sequence for a new chat session");
+        return 0;
+    }
 
-    LOGI("Running video inference: %d frames", n_frames);
-    auto t_start = steady_clock::now();
+    auto * session = new ChatSession();
+    session->vctx    = vctx;
+    session->seq_id  = seq_id;
+    session->seed    = std::random_device{}();
+    LOGI("Chat session created on sequence %d", seq_id);
+    return reinterpret_cast<jlong>(session);
+}
 
-    // Create bitmaps for each frame
-    std::vector<mtmd_bitmap *> bitmaps(n_frames);
-    std::vector<jbyte *> frame_ptrs(n_frames);
-    std::vector<jbyteArray> frame_refs(n_frames);
+// First turn: prefill the encoded images and the prompt into the session, then stream the reply
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_chatSessionStart(
+        JNIEnv * env, jobject /* thiz */,
+        jlong session_ptr, jlong request_ptr, jlongArray embd_ptrs, jstring prompt, jobject callback) {
 
-    for (int i = 0; i < n_frames; i++) {
-        frame_refs[i] = (jbyteArray)env->GetObjectArrayElement(frames_array, i);
-        frame_ptrs[i] = env->GetByteArrayElements(frame_refs[i], nullptr);
-        bitmaps[i] = mtmd_bitmap_init(
-            (uint32_t)w_arr[i], (uint32_t)h_arr[i],
-            reinterpret_cast<const unsigned char *>(frame_ptrs[i])
-        );
-        LOGI("  Frame %d: %dx%d", i, w_arr[i], h_arr[i]);
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session) {
+        callback_error(env, callback, "Chat session was released");
+        return;
     }
+    VisionAIContext * vctx = session->vctx;
+    ActiveRequest active(vctx, request_ptr);
 
-    // Build user content with prompt BEFORE markers so the instruction has more weight
-    const char * marker = mtmd_default_marker();
-    std::string user_content = std::string(prompt_c) + "\n";
-    for (int i = 0; i < n_frames; i++) {
-        user_content += std::string(marker) + "\n";
+    std::vector<ImageEmbedding *> images;
+    if (!images_from_handles(env, embd_ptrs, images)) {
+        callback_error(env, callback, "Image embedding was released");
+        return;
     }
-    std::string formatted = apply_chat_template(vctx->model, user_content);
+    int n_images = (int) images.size();
 
-    mtmd_input_text text;
-    text.text          = formatted.c_str();
-    text.add_special   = false; // chat template already includes BOS
-    text.parse_special = true;
+    auto t_start = steady_clock::now();
 
-    // Convert to const pointer array
-    std::vector<const mtmd_bitmap *> bitmap_ptrs(bitmaps.begin(), bitmaps.end());
-    mtmd_input_chunks * chunks = mtmd_input_chunks_init();
+    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
+    session->messages = { { "user", build_user_content(prompt_c, images.size()) } };
+    env->ReleaseStringUTFChars(prompt, prompt_c);
 
-    int32_t tokenize_res = mtmd_tokenize(vctx->ctx_mtmd, chunks, &text, bitmap_ptrs.data(), n_frames);
-    if (tokenize_res != 0) {
-        LOGE("Failed to tokenize video, error: %d", tokenize_res);
-        for (int i = 0; i < n_frames; i++) {
-            mtmd_bitmap_free(bitmaps[i]);
-            env->ReleaseByteArrayElements(frame_refs[i], frame_ptrs[i], JNI_ABORT);
-        }
-        mtmd_input_chunks_free(chunks);
-        env->ReleaseIntArrayElements(widths, w_arr, JNI_ABORT);
-        env->ReleaseIntArrayElements(heights, h_arr, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        throw_java_exception(env, "Failed to tokenize video input");
-        return env->NewStringUTF("");
+    session->image_hashes.clear();
+    for (const ImageEmbedding * emb : images) {
+        session->image_hashes.push_back(emb->hash);
+    }
+    session->recent.clear();
+    reset_session_sampler(session);
+
+    report_visual_tokens(vctx, images);
+    std::string formatted = format_chat(vctx->model, session->messages, true);
+    // The first turn starts after the system prefix, which eviction always keeps
+    const std::string & prefix = vctx->system_prefix;
+    const bool has_system = !vctx->system_tokens.empty() && formatted.compare(0, prefix.size(), prefix) == 0;
+    session->turn_start = { has_system ? (llama_pos) vctx->system_tokens.size() : 0 };
+    if (!eval_prompt(vctx, formatted, images, session->seq_id, session->n_past)) {
+        session->messages.clear();
+        callback_error(env, callback, "Failed to evaluate input");
+        return;
     }
 
-    llama_memory_clear(llama_get_memory(vctx->ctx), true);
-    create_sampler(vctx);
+    auto t_after_eval = steady_clock::now();
 
-    auto t_after_tokenize = steady_clock::now();
+    GenerationState gen = { session->sampler, session->seq_id, session->n_past };
+    std::string response = generate_response(vctx, gen, session->max_reply, env, callback);
+    finish_turn(session, gen, response);
 
-    llama_pos n_past = 0;
-    int32_t eval_res = mtmd_helper_eval_chunks(
-        vctx->ctx_mtmd, vctx->ctx, chunks,
-        n_past, 0, 128, true, &n_past
-    );
-
-    if (eval_res != 0) {
-        LOGE("Failed to evaluate video chunks, error: %d", eval_res);
-        for (int i = 0; i < n_frames; i++) {
-            mtmd_bitmap_free(bitmaps[i]);
-            env->ReleaseByteArrayElements(frame_refs[i], frame_ptrs[i], JNI_ABORT);
-        }
-        mtmd_input_chunks_free(chunks);
-        env->ReleaseIntArrayElements(widths, w_arr, JNI_ABORT);
-        env->ReleaseIntArrayElements(heights, h_arr, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        throw_java_exception(env, "Failed to evaluate video input");
-        return env->NewStringUTF("");
+    LOGI("=== CHAT START BENCHMARK === Images: %d | Prefill: %d tokens in %lld ms | Total: %lld ms",
+         n_images, session->n_past, elapsed_ms(t_start, t_after_eval), elapsed_ms(t_start, steady_clock::now()));
+
+    callback_complete(env, callback, response);
+}
+
+// Follow-up turn: decode only the new question and assistant header on top of the session's KV.
+// Images given here (e.g. a crop encoded with encodeImage) join the question, so a detail can be
+// asked about at full encoder resolution while the global view stays in the cache.
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_chatSessionAsk(
+        JNIEnv * env, jobject /* thiz */,
+        jlong session_ptr, jlong request_ptr, jlongArray embd_ptrs, jstring question, jobject callback) {
+
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session || session->messages.empty()) {
+        callback_error(env, callback, "Chat session not started");
+        return;
     }
+    VisionAIContext * vctx = session->vctx;
+    ActiveRequest active(vctx, request_ptr);
 
-    auto t_after_eval = steady_clock::now();
+    std::vector<ImageEmbedding *> images;
+    if (!images_from_handles(env, embd_ptrs, images)) {
+        callback_error(env, callback, "Image embedding was released");
+        return;
+    }
 
-    std::string response = generate_response(vctx, MAX_TOKENS);
+    auto t_start = steady_clock::now();
 
-    auto t_end = steady_clock::now();
-    auto ms = [](steady_clock::time_point a, steady_clock::time_point b) {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
-    };
-    LOGI("=== VIDEO BENCHMARK === Frames: %d | Tokenize: %lld ms | Eval: %lld ms | Total: %lld ms",
-         n_frames, ms(t_start, t_after_tokenize), ms(t_after_tokenize, t_after_eval), ms(t_start, t_end));
+    const char * question_c = env->GetStringUTFChars(question, nullptr);
+    const std::string content = images.empty() ? std::string(question_c) : build_user_content(question_c, images.size());
+    size_t n_close = 0;
+    const llama_vocab * vocab = llama_model_get_vocab(vctx->model);
+    std::string delta = chat_turn_delta(vctx->model, session->messages, content, n_close);
+    env->ReleaseStringUTFChars(question, question_c);
 
-    // Cleanup
-    for (int i = 0; i < n_frames; i++) {
-        mtmd_bitmap_free(bitmaps[i]);
-        env->ReleaseByteArrayElements(frame_refs[i], frame_ptrs[i], JNI_ABORT);
+    // The previous reply's closing tokens belong to its turn, so evicting it leaves none behind
+    std::vector<PromptSegment> segments;
+    if (n_close > 0) {
+        segments.push_back({ tokenize_text(vocab, delta.substr(0, n_close)), nullptr });
     }
-    mtmd_input_chunks_free(chunks);
-    env->ReleaseIntArrayElements(widths, w_arr, JNI_ABORT);
-    env->ReleaseIntArrayElements(heights, h_arr, JNI_ABORT);
-    env->ReleaseStringUTFChars(prompt, prompt_c);
+    const size_t n_closing = segments.empty() ? 0 : segments[0].tokens.size();
+    if (!split_prompt(vctx, delta.substr(n_close), images, segments)) {
+        session->messages.pop_back();
+        callback_error(env, callback, "Failed to evaluate question");
+        return;
+    }
+    size_t n_new = 0;
+    for (const PromptSegment & seg : segments) {
+        n_new += seg.image ? (size_t) seg.image->n_pos : seg.tokens.size();
+    }
+    if (!chat_fits(session, n_new)) {
+        session->messages.pop_back();
+        callback_error(env, callback, "Conversation does not fit in the context");
+        return;
+    }
+    // Taken after chat_fits, which may have shifted the earlier turns down
+    const llama_pos turn_start = session->n_past + (llama_pos) n_closing;
 
-    return env->NewStringUTF(response.c_str());
+    if (!images.empty()) {
+        report_visual_tokens(vctx, images);
+    }
+    const llama_pos n_past_before = session->n_past;
+    if (!eval_segments(vctx, segments, 0, session->seq_id, session->n_past)) {
+        // Drop whatever part of the question made it into the cache before the failure or cancel
+        llama_memory_seq_rm(llama_get_memory(vctx->ctx), session->seq_id, n_past_before, -1);
+        session->n_past = n_past_before;
+        session->messages.pop_back();
+        callback_error(env, callback, "Failed to evaluate question");
+        return;
+    }
+
+    auto t_after_eval = steady_clock::now();
+    const llama_pos n_prefill = session->n_past - n_past_before;
+
+    reset_session_sampler(session);
+    GenerationState gen = { session->sampler, session->seq_id, session->n_past };
+    std::string response = generate_response(vctx, gen, session->max_reply, env, callback);
+    finish_turn(session, gen, response);
+    if (!session->turn_start.empty()) {
+        session->turn_start.push_back(turn_start);
+        evict_turns(session);
+    }
+
+    LOGI("=== CHAT TURN BENCHMARK === Images: %zu | Prefill: %d positions in %lld ms | Context: %d | Total: %lld ms",
+         images.size(), n_prefill, elapsed_ms(t_start, t_after_eval), session->n_past,
+         elapsed_ms(t_start, steady_clock::now()));
+
+    callback_complete(env, callback, response);
 }
 
-// Single image inference — streaming version
+// Start a first turn whose frames arrive while they are recorded: prefill the templated text up
+// to the first frame now, so stopping only leaves the end of the turn and the reply
 JNIEXPORT void JNICALL
-Java_com_example_visionai_inference_LlamaModel_runInferenceStreaming(
-        JNIEnv * env, jobject /* thiz */,
-        jlong ctx_ptr, jbyteArray image_bytes, jint width, jint height,
-        jstring prompt, jobject callback) {
+Java_com_example_visionai_inference_LlamaModel_chatSessionBeginFrames(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr, jlong request_ptr, jstring prompt) {
 
-    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
-    if (!vctx || !vctx->model || !vctx->ctx || !vctx->ctx_mtmd) {
-        throw_java_exception(env, "Model not loaded");
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session) {
+        throw_java_exception(env, "Chat session was released");
         return;
     }
+    VisionAIContext * vctx = session->vctx;
+    ActiveRequest active(vctx, request_ptr);
 
-    jclass cbClass = env->GetObjectClass(callback);
-    jmethodID onCompleteMethod = env->GetMethodID(cbClass, "onComplete", "(Ljava/lang/String;)V");
-    jmethodID onErrorMethod = env->GetMethodID(cbClass, "onError", "(Ljava/lang/String;)V");
+    auto t_start = steady_clock::now();
 
+    static const char * SENTINEL = "\x01frames\x01";
     const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
-    jbyte * img_data = env->GetByteArrayElements(image_bytes, nullptr);
+    const std::string prompt_str = prompt_c;
+    env->ReleaseStringUTFChars(prompt, prompt_c);
+    const std::string formatted = format_chat(vctx->model, { { "user", prompt_str + "\n" + SENTINEL } }, true);
+    const size_t at = formatted.find(SENTINEL);
+    if (at == std::string::npos) {
+        throw_java_exception(env, "Chat template dropped the frames");
+        return;
+    }
+
+    session->ingesting = false;
+    session->messages.clear();
+    session->image_hashes.clear();
+    session->recent.clear();
+    reset_session_sampler(session);
+
+    const std::string head = formatted.substr(0, at);
+    const std::string & prefix = vctx->system_prefix;
+    const bool has_system = !vctx->system_tokens.empty() && head.compare(0, prefix.size(), prefix) == 0;
+    session->turn_start = { has_system ? (llama_pos) vctx->system_tokens.size() : 0 };
+    if (!eval_prompt(vctx, head, {}, session->seq_id, session->n_past)) {
+        throw_java_exception(env, "Failed to evaluate prompt");
+        return;
+    }
+
+    session->ingesting     = true;
+    session->frames_prompt = prompt_str;
+    session->frames_suffix = formatted.substr(at + strlen(SENTINEL));
+    session->n_frames      = 0;
+    session->frames_start  = t_start;
+    LOGI("Frame ingestion started: %d positions in %lld ms", session->n_past,
+         elapsed_ms(t_start, steady_clock::now()));
+}
+
+// Encode one recorded frame (`timestamp_ms` into the recording) and prefill it into the session
+// right away. Returns the embedding handle, which the caller owns, for Q&A without the session.
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_chatSessionAppendFrame(
+        JNIEnv * env, jobject /* thiz */,
+        jlong session_ptr, jlong request_ptr, jobject image_buffer, jint width, jint height,
+        jlong timestamp_ms, jint max_visual_tokens) {
+
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session || !session->ingesting) {
+        throw_java_exception(env, "Frame ingestion not started");
+        return 0;
+    }
+    VisionAIContext * vctx = session->vctx;
+    ActiveRequest active(vctx, request_ptr);
 
-    LOGI("Running streaming inference: %dx%d image", width, height);
     auto t_start = steady_clock::now();
+    ImageEmbedding * emb = encode_image_buffer(env, vctx, image_buffer, width, height,
+                                               (size_t) std::max(0, max_visual_tokens));
+    if (!emb) {
+        throw_java_exception(env, "Failed to encode image");
+        return 0;
+    }
+    auto t_after_encode = steady_clock::now();
 
-    mtmd_bitmap * bmp = mtmd_bitmap_init(
-        (uint32_t)width, (uint32_t)height,
-        reinterpret_cast<const unsigned char *>(img_data)
-    );
+    // The newline after the previous frame goes in first, as split_prompt would tokenize it
+    std::vector<PromptSegment> segments;
+    if (session->n_frames > 0) {
+        segments.push_back({ tokenize_text(llama_model_get_vocab(vctx->model), "\n"), nullptr });
+    }
+    segments.push_back({ {}, emb });
+    size_t n_new = 0;
+    for (const PromptSegment & seg : segments) {
+        n_new += seg.image ? (size_t) seg.image->n_pos : seg.tokens.size();
+    }
+    if (!chat_fits(session, n_new)) {
+        delete emb;
+        throw_java_exception(env, "Video does not fit in the context");
+        return 0;
+    }
 
-    const char * marker = mtmd_default_marker();
-    std::string user_content = std::string(marker) + "\n" + prompt_c;
-    std::string formatted = apply_chat_template(vctx->model, user_content);
+    const llama_pos n_past_before = session->n_past;
+    for (const PromptSegment & seg : segments) {
+        const bool ok = seg.image
+                        ? decode_image(vctx, seg.image, session->seq_id, session->n_past)
+                        : decode_tokens(vctx, seg.tokens.data(), seg.tokens.size(), session->seq_id, session->n_past, false);
+        if (!ok) {
+            llama_memory_seq_rm(llama_get_memory(vctx->ctx), session->seq_id, n_past_before, -1);
+            session->n_past = n_past_before;
+            delete emb;
+            throw_java_exception(env, "Failed to evaluate frame");
+            return 0;
+        }
+    }
 
-    mtmd_input_text text;
-    text.text          = formatted.c_str();
-    text.add_special   = false;
-    text.parse_special = true;
+    session->n_frames++;
+    session->image_hashes.push_back(emb->hash);
+    report_visual_tokens(vctx, { emb });
+    LOGI("Frame %zu at %lld ms: %zu tokens | Encode: %lld ms | Prefill: %d positions in %lld ms",
+         session->n_frames, (long long) timestamp_ms, emb->n_tokens, elapsed_ms(t_start, t_after_encode),
+         session->n_past - n_past_before, elapsed_ms(t_after_encode, steady_clock::now()));
+    return reinterpret_cast<jlong>(emb);
+}
 
-    const mtmd_bitmap * bitmaps[] = { bmp };
-    mtmd_input_chunks * chunks = mtmd_input_chunks_init();
+// Recording stopped: close the turn the frames were appended to and stream the reply
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_chatSessionFinishFrames(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr, jlong request_ptr, jobject callback) {
 
-    int32_t tokenize_res = mtmd_tokenize(vctx->ctx_mtmd, chunks, &text, bitmaps, 1);
-    if (tokenize_res != 0) {
-        LOGE("Failed to tokenize, error: %d", tokenize_res);
-        mtmd_input_chunks_free(chunks);
-        mtmd_bitmap_free(bmp);
-        env->ReleaseByteArrayElements(image_bytes, img_data, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        jstring jerr = env->NewStringUTF("Failed to tokenize input");
-        env->CallVoidMethod(callback, onErrorMethod, jerr);
-        env->DeleteLocalRef(jerr);
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session || !session->ingesting || session->n_frames == 0) {
+        callback_error(env, callback, "No frames were recorded");
         return;
     }
+    VisionAIContext * vctx = session->vctx;
+    ActiveRequest active(vctx, request_ptr);
 
-    llama_memory_clear(llama_get_memory(vctx->ctx), true);
-    create_sampler(vctx);
-
-    llama_pos n_past = 0;
-    int32_t eval_res = mtmd_helper_eval_chunks(
-        vctx->ctx_mtmd, vctx->ctx, chunks,
-        n_past, 0, 128, true, &n_past
-    );
-
-    if (eval_res != 0) {
-        LOGE("Failed to evaluate chunks, error: %d", eval_res);
-        mtmd_input_chunks_free(chunks);
-        mtmd_bitmap_free(bmp);
-        env->ReleaseByteArrayElements(image_bytes, img_data, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        jstring jerr = env->NewStringUTF("Failed to evaluate input");
-        env->CallVoidMethod(callback, onErrorMethod, jerr);
-        env->DeleteLocalRef(jerr);
+    auto t_start = steady_clock::now();
+    const std::vector<llama_token> tail = tokenize_text(llama_model_get_vocab(vctx->model), "\n" + session->frames_suffix);
+    const llama_pos n_past_before = session->n_past;
+    if (!decode_tokens(vctx, tail.data(), tail.size(), session->seq_id, session->n_past, true)) {
+        llama_memory_seq_rm(llama_get_memory(vctx->ctx), session->seq_id, n_past_before, -1);
+        session->n_past = n_past_before;
+        callback_error(env, callback, "Failed to evaluate input");
         return;
     }
+    auto t_after_eval = steady_clock::now();
 
-    std::string response = generate_response_streaming(vctx, MAX_TOKENS, env, callback);
+    session->ingesting = false;
+    session->messages  = { { "user", frames_user_content(session->frames_prompt, session->n_frames) } };
 
-    auto t_end = steady_clock::now();
-    auto ms = [](steady_clock::time_point a, steady_clock::time_point b) {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
-    };
-    LOGI("=== PHOTO STREAMING BENCHMARK === Total: %lld ms", ms(t_start, t_end));
+    GenerationState gen = { session->sampler, session->seq_id, session->n_past };
+    std::string response = generate_response(vctx, gen, session->max_reply, env, callback);
+    finish_turn(session, gen, response);
 
-    mtmd_input_chunks_free(chunks);
-    mtmd_bitmap_free(bmp);
-    env->ReleaseByteArrayElements(image_bytes, img_data, JNI_ABORT);
-    env->ReleaseStringUTFChars(prompt, prompt_c);
+    LOGI("=== VIDEO INGEST BENCHMARK === Frames: %zu | Stop to reply: %zu tokens prefilled in %lld ms | "
+         "Context: %d | Recording: %lld ms | Total: %lld ms",
+         session->n_frames, tail.size(), elapsed_ms(t_start, t_after_eval), session->n_past,
+         elapsed_ms(session->frames_start, t_start), elapsed_ms(t_start, steady_clock::now()));
 
-    jstring jresult = env->NewStringUTF(response.c_str());
-    env->CallVoidMethod(callback, onCompleteMethod, jresult);
-    env->DeleteLocalRef(jresult);
+    callback_complete(env, callback, response);
 }
 
-// Multi-frame video inference — streaming version
+// Keep only the last `max_turns` turns in the session (0 = all) and cap each reply at
+// `max_reply_tokens` (0 = the default MAX_TOKENS)
 JNIEXPORT void JNICALL
-Java_com_example_visionai_inference_LlamaModel_runVideoInferenceStreaming(
-        JNIEnv * env, jobject /* thiz */,
-        jlong ctx_ptr, jobjectArray frames_array, jintArray widths, jintArray heights,
-        jstring prompt, jobject callback) {
+Java_com_example_visionai_inference_LlamaModel_chatSessionSetLimits(
+        JNIEnv * /* env */, jobject /* thiz */, jlong session_ptr, jint max_turns, jint max_reply_tokens) {
 
-    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
-    if (!vctx || !vctx->model || !vctx->ctx || !vctx->ctx_mtmd) {
-        throw_java_exception(env, "Model not loaded");
-        return;
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session) return;
+    session->max_turns = (size_t) std::max(0, max_turns);
+    session->max_reply = max_reply_tokens > 0 ? std::min((int) max_reply_tokens, MAX_TOKENS) : MAX_TOKENS;
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_freeChatSession(
+        JNIEnv * /* env */, jobject /* thiz */, jlong session_ptr) {
+
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session) return;
+
+    release_seq(session->vctx, session->seq_id);
+    if (session->sampler) llama_sampler_free(session->sampler);
+    delete session;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_example_visionai_inference_LlamaModel_chatSessionSave(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr, jstring path) {
+
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session || session->messages.empty()) return JNI_FALSE;
+
+    auto t_start = steady_clock::now();
+    const char * path_c = env->GetStringUTFChars(path, nullptr);
+    bool ok = save_session(session, path_c);
+    env->ReleaseStringUTFChars(path, path_c);
+
+    LOGI("Session saved: %s | Context: %d | %lld ms",
+         ok ? "ok" : "failed", session->n_past, elapsed_ms(t_start, steady_clock::now()));
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+// Resume a saved conversation without running the vision encoder or prefill again
+JNIEXPORT jboolean JNICALL
+Java_com_example_visionai_inference_LlamaModel_chatSessionRestore(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr, jstring path, jlong image_hash) {
+
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    if (!session) return JNI_FALSE;
+
+    auto t_start = steady_clock::now();
+    const char * path_c = env->GetStringUTFChars(path, nullptr);
+    bool ok = restore_session(session, path_c, (uint64_t) image_hash);
+    env->ReleaseStringUTFChars(path, path_c);
+
+    if (ok) {
+        LOGI("=== SESSION RESTORE BENCHMARK === Context: %d tokens | Turns: %zu | Total: %lld ms",
+             session->n_past, session->messages.size() / 2, elapsed_ms(t_start, steady_clock::now()));
     }
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
 
-    jclass cbClass = env->GetObjectClass(callback);
-    jmethodID onCompleteMethod = env->GetMethodID(cbClass, "onComplete", "(Ljava/lang/String;)V");
-    jmethodID onErrorMethod = env->GetMethodID(cbClass, "onError", "(Ljava/lang/String;)V");
+// Conversation so far as alternating role/content strings
+JNIEXPORT jobjectArray JNICALL
+Java_com_example_visionai_inference_LlamaModel_chatSessionHistory(
+        JNIEnv * env, jobject /* thiz */, jlong session_ptr) {
+
+    auto * session = reinterpret_cast<ChatSession *>(session_ptr);
+    const size_t n = session ? session->messages.size() : 0;
+
+    jobjectArray result = env->NewObjectArray((jsize) (n * 2), env->FindClass("java/lang/String"), nullptr);
+    for (size_t i = 0; i < n; i++) {
+        const auto & [role, content] = session->messages[i];
+        jstring jrole    = env->NewStringUTF(role.c_str());
+        jstring jcontent = env->NewStringUTF(content.c_str());
+        env->SetObjectArrayElement(result, (jsize) (i * 2), jrole);
+        env->SetObjectArrayElement(result, (jsize) (i * 2 + 1), jcontent);
+        env->DeleteLocalRef(jrole);
+        env->DeleteLocalRef(jcontent);
+    }
+    return result;
+}
 
-    const char * prompt_c = env->GetStringUTFChars(prompt, nullptr);
-    int n_frames = env->GetArrayLength(frames_array);
-    jint * w_arr = env->GetIntArrayElements(widths, nullptr);
-    jint * h_arr = env->GetIntArrayElements(heights, nullptr);
+// Camera frame straight from ImageAnalysis: rotate, downscale and convert YUV_420_888 into an
+// RGBA direct buffer in one pass, replacing the Bitmap/Matrix/createScaledBitmap chain.
+// Returns the frame's perceptual hash (frame_dhash), taken while its pixels are still hot.
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_yuvToRgba(
+        JNIEnv * env, jobject /* thiz */,
+        jobject y_buffer, jobject u_buffer, jobject v_buffer,
+        jint y_row_stride, jint uv_row_stride, jint uv_pixel_stride,
+        jint width, jint height, jint rotation,
+        jobject dst_buffer, jint dst_width, jint dst_height) {
+
+    YuvPlanes src;
+    src.y = static_cast<const uint8_t *>(env->GetDirectBufferAddress(y_buffer));
+    src.u = static_cast<const uint8_t *>(env->GetDirectBufferAddress(u_buffer));
+    src.v = static_cast<const uint8_t *>(env->GetDirectBufferAddress(v_buffer));
+    src.y_row_stride    = y_row_stride;
+    src.uv_row_stride   = uv_row_stride;
+    src.uv_pixel_stride = uv_pixel_stride;
+    src.width  = width;
+    src.height = height;
+    auto * dst = static_cast<uint8_t *>(env->GetDirectBufferAddress(dst_buffer));
+
+    // Last byte each plane is read at, so a short or odd-strided buffer fails instead of overrunning
+    const jlong y_end  = (jlong) (height - 1) * y_row_stride + width;
+    const jlong uv_end = (jlong) ((height - 1) / 2) * uv_row_stride +
+                         (jlong) ((width - 1) / 2) * uv_pixel_stride + 1;
+    if (!src.y || !src.u || !src.v || !dst || width <= 0 || height <= 0 ||
+            dst_width <= 0 || dst_height <= 0 || rotation % 90 != 0 ||
+            env->GetDirectBufferCapacity(y_buffer) < y_end ||
+            env->GetDirectBufferCapacity(u_buffer) < uv_end ||
+            env->GetDirectBufferCapacity(v_buffer) < uv_end ||
+            env->GetDirectBufferCapacity(dst_buffer) < (jlong) dst_width * dst_height * 4) {
+        throw_java_exception(env, "Invalid YUV frame");
+        return 0;
+    }
 
-    LOGI("Running streaming video inference: %d frames", n_frames);
     auto t_start = steady_clock::now();
+    yuv420_to_rgba(dst, dst_width, dst_height, src, ((rotation % 360) + 360) % 360);
+    const uint64_t hash = frame_dhash(dst, dst_width, dst_height, (size_t) dst_width * 4);
+    LOGI("YUV %dx%d rot %d -> RGBA %dx%d: %lld us", width, height, rotation, dst_width, dst_height,
+         (long long) std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - t_start).count());
+    return (jlong) hash;
+}
 
-    std::vector<mtmd_bitmap *> bitmaps(n_frames);
-    std::vector<jbyte *> frame_ptrs(n_frames);
-    std::vector<jbyteArray> frame_refs(n_frames);
+// Perceptual hash of an RGBA_8888 Bitmap, for frames that did not come through yuvToRgba
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_perceptualHash(
+        JNIEnv * env, jobject /* thiz */, jobject bitmap) {
+
+    AndroidBitmapInfo info;
+    void * pixels = nullptr;
+    if (AndroidBitmap_getInfo(env, bitmap, &info) != ANDROID_BITMAP_RESULT_SUCCESS ||
+            info.format != ANDROID_BITMAP_FORMAT_RGBA_8888 ||
+            AndroidBitmap_lockPixels(env, bitmap, &pixels) != ANDROID_BITMAP_RESULT_SUCCESS) {
+        throw_java_exception(env, "Perceptual hash needs an ARGB_8888 bitmap");
+        return 0;
+    }
+    const uint64_t hash = frame_dhash(static_cast<const uint8_t *>(pixels),
+                                      (int) info.width, (int) info.height, info.stride);
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return (jlong) hash;
+}
 
-    for (int i = 0; i < n_frames; i++) {
-        frame_refs[i] = (jbyteArray)env->GetObjectArrayElement(frames_array, i);
-        frame_ptrs[i] = env->GetByteArrayElements(frame_refs[i], nullptr);
-        bitmaps[i] = mtmd_bitmap_init(
-            (uint32_t)w_arr[i], (uint32_t)h_arr[i],
-            reinterpret_cast<const unsigned char *>(frame_ptrs[i])
-        );
+// Compressed photo (the JPEG ImageCapture hands over) straight to a model-sized RGBA buffer.
+// The platform decoder honours the target size inside the IDCT (1/2, 1/4, 1/8) and only
+// resamples the remainder, so a 12 MP capture is never materialised at full resolution.
+// EXIF orientation is applied by the decoder; `rotation` is whatever is left on top of it.
+__attribute__((availability(android, introduced = 30)))
+static bool decode_compressed(const void * data, size_t size, int rotation, int max_dim,
+                              uint8_t * dst, size_t dst_size, jint out_dims[2]) {
+    auto t_start = steady_clock::now();
+
+    AImageDecoder * decoder = nullptr;
+    if (AImageDecoder_createFromBuffer(data, size, &decoder) != ANDROID_IMAGE_DECODER_SUCCESS) {
+        LOGE("decodeImage: unsupported or corrupt image");
+        return false;
+    }
+    std::unique_ptr<AImageDecoder, void (*)(AImageDecoder *)> guard(decoder, AImageDecoder_delete);
+    AImageDecoder_setAndroidBitmapFormat(decoder, ANDROID_BITMAP_FORMAT_RGBA_8888);
+
+    const AImageDecoderHeaderInfo * info = AImageDecoder_getHeaderInfo(decoder);
+    const int src_w = AImageDecoderHeaderInfo_getWidth(info);
+    const int src_h = AImageDecoderHeaderInfo_getHeight(info);
+    const float scale = std::min(1.0f, (float) max_dim / std::max(src_w, src_h));
+    const int w = std::max(1, (int) (src_w * scale));
+    const int h = std::max(1, (int) (src_h * scale));
+    if (AImageDecoder_setTargetSize(decoder, w, h) != ANDROID_IMAGE_DECODER_SUCCESS) {
+        LOGE("decodeImage: cannot scale %dx%d to %dx%d", src_w, src_h, w, h);
+        return false;
     }
 
-    const char * marker = mtmd_default_marker();
-    std::string user_content = std::string(prompt_c) + "\n";
-    for (int i = 0; i < n_frames; i++) {
-        user_content += std::string(marker) + "\n";
+    const size_t stride  = AImageDecoder_getMinimumStride(decoder);
+    const size_t n_bytes = (size_t) w * h * 4;
+    if (dst_size < n_bytes) {
+        LOGE("decodeImage: destination too small for %dx%d", w, h);
+        return false;
     }
-    std::string formatted = apply_chat_template(vctx->model, user_content);
 
-    mtmd_input_text text;
-    text.text          = formatted.c_str();
-    text.add_special   = false;
-    text.parse_special = true;
+    int rc;
+    if (rotation == 0 && stride == (size_t) w * 4) {
+        rc = AImageDecoder_decodeImage(decoder, dst, stride, n_bytes);
+    } else {
+        std::vector<uint8_t> pixels(stride * h);
+        rc = AImageDecoder_decodeImage(decoder, pixels.data(), stride, pixels.size());
+        if (rc == ANDROID_IMAGE_DECODER_SUCCESS) {
+            rotate_rgba(dst, pixels.data(), w, h, stride, rotation);
+        }
+    }
+    if (rc != ANDROID_IMAGE_DECODER_SUCCESS) {
+        LOGE("decodeImage: decode failed (%d)", rc);
+        return false;
+    }
 
-    std::vector<const mtmd_bitmap *> bitmap_ptrs(bitmaps.begin(), bitmaps.end());
-    mtmd_input_chunks * chunks = mtmd_input_chunks_init();
+    const bool transpose = rotation == 90 || rotation == 270;
+    out_dims[0] = transpose ? h : w;
+    out_dims[1] = transpose ? w : h;
+    LOGI("=== DECODE BENCHMARK === %dx%d -> %dx%d (rot %d) | %lld ms",
+         src_w, src_h, out_dims[0], out_dims[1], rotation, elapsed_ms(t_start, steady_clock::now()));
+    return true;
+}
 
-    int32_t tokenize_res = mtmd_tokenize(vctx->ctx_mtmd, chunks, &text, bitmap_ptrs.data(), n_frames);
-    if (tokenize_res != 0) {
-        LOGE("Failed to tokenize video, error: %d", tokenize_res);
-        for (int i = 0; i < n_frames; i++) {
-            mtmd_bitmap_free(bitmaps[i]);
-            env->ReleaseByteArrayElements(frame_refs[i], frame_ptrs[i], JNI_ABORT);
-        }
-        mtmd_input_chunks_free(chunks);
-        env->ReleaseIntArrayElements(widths, w_arr, JNI_ABORT);
-        env->ReleaseIntArrayElements(heights, h_arr, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        jstring jerr = env->NewStringUTF("Failed to tokenize video input");
-        env->CallVoidMethod(callback, onErrorMethod, jerr);
-        env->DeleteLocalRef(jerr);
-        return;
+// `rotation` is ImageInfo.rotationDegrees. Fills dims with the output size; false if the
+// decoder is unavailable (API < 30) or fails
+JNIEXPORT jboolean JNICALL
+Java_com_example_visionai_inference_LlamaModel_decodeImage(
+        JNIEnv * env, jobject /* thiz */,
+        jobject src_buffer, jint src_size, jint rotation, jint max_dim,
+        jobject dst_buffer, jintArray dims) {
+
+    const void * data = env->GetDirectBufferAddress(src_buffer);
+    auto * dst = static_cast<uint8_t *>(env->GetDirectBufferAddress(dst_buffer));
+    if (!data || !dst || src_size <= 0 || env->GetDirectBufferCapacity(src_buffer) < src_size) {
+        LOGE("decodeImage: expected direct source and destination buffers");
+        return JNI_FALSE;
     }
 
-    llama_memory_clear(llama_get_memory(vctx->ctx), true);
-    create_sampler(vctx);
+    // CameraX reports the EXIF rotation when the JPEG has one, which the decoder already
+    // applies; only frames without the tag still need turning here
+    if (jpeg_exif_orientation(static_cast<const uint8_t *>(data), (size_t) src_size) > 1) {
+        rotation = 0;
+    }
 
-    llama_pos n_past = 0;
-    int32_t eval_res = mtmd_helper_eval_chunks(
-        vctx->ctx_mtmd, vctx->ctx, chunks,
-        n_past, 0, 128, true, &n_past
-    );
-
-    if (eval_res != 0) {
-        LOGE("Failed to evaluate video chunks, error: %d", eval_res);
-        for (int i = 0; i < n_frames; i++) {
-            mtmd_bitmap_free(bitmaps[i]);
-            env->ReleaseByteArrayElements(frame_refs[i], frame_ptrs[i], JNI_ABORT);
-        }
-        mtmd_input_chunks_free(chunks);
-        env->ReleaseIntArrayElements(widths, w_arr, JNI_ABORT);
-        env->ReleaseIntArrayElements(heights, h_arr, JNI_ABORT);
-        env->ReleaseStringUTFChars(prompt, prompt_c);
-        jstring jerr = env->NewStringUTF("Failed to evaluate video input");
-        env->CallVoidMethod(callback, onErrorMethod, jerr);
-        env->DeleteLocalRef(jerr);
-        return;
+    if (__builtin_available(android 30, *)) {
+        jint out[2];
+        if (decode_compressed(data, (size_t) src_size, ((rotation % 360) + 360) % 360, max_dim,
+                              dst, (size_t) env->GetDirectBufferCapacity(dst_buffer), out)) {
+            env->SetIntArrayRegion(dims, 0, 2, out);
+            return JNI_TRUE;
+        }
     }
+    return JNI_FALSE;
+}
 
-    std::string response = generate_response_streaming(vctx, MAX_TOKENS, env, callback);
+// Visual tokens of the request's images as prefilled or encoded; valid once its call has returned
+JNIEXPORT jint JNICALL
+Java_com_example_visionai_inference_LlamaModel_requestVisualTokens(
+        JNIEnv * /* env */, jobject /* thiz */, jlong request_ptr) {
+    auto * req = reinterpret_cast<Request *>(request_ptr);
+    return req ? (jint) req->n_visual_tokens : 0;
+}
 
-    auto t_end = steady_clock::now();
-    auto ms = [](steady_clock::time_point a, steady_clock::time_point b) {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
-    };
-    LOGI("=== VIDEO STREAMING BENCHMARK === Frames: %d | Total: %lld ms", n_frames, ms(t_start, t_end));
+// Share of visual tokens to keep when merging, applied to images encoded from now on
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_setVisualTokenKeepRatio(
+        JNIEnv * /* env */, jobject /* thiz */, jlong ctx_ptr, jfloat ratio) {
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (vctx) {
+        vctx->token_keep_ratio = std::clamp((float) ratio, 0.0f, 1.0f);
+    }
+}
+
+// Cosine distance at which gateFrame counts a frame as a new scene
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_setChangeGateThreshold(
+        JNIEnv * /* env */, jobject /* thiz */, jlong ctx_ptr, jfloat threshold) {
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (vctx) {
+        vctx->gate_threshold = std::clamp((float) threshold, 0.0f, 2.0f);
+    }
+}
+
+// Forget the reference frame and zero the counters; the next gated frame always passes
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_changeGateReset(
+        JNIEnv * /* env */, jobject /* thiz */, jlong ctx_ptr) {
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (vctx) {
+        vctx->gate_frames  = 0;
+        vctx->gate_skipped = 0;
+        vctx->gate_last_distance = 0.0f;
+        vctx->gate_reset = true;
+    }
+}
+
+// { frames gated, frames held back, last distance } since the last reset
+JNIEXPORT jfloatArray JNICALL
+Java_com_example_visionai_inference_LlamaModel_readChangeGateStats(
+        JNIEnv * env, jobject /* thiz */, jlong ctx_ptr) {
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    jfloat stats[3] = { 0.0f, 0.0f, 0.0f };
+    if (vctx) {
+        stats[0] = (jfloat) vctx->gate_frames.load();
+        stats[1] = (jfloat) vctx->gate_skipped.load();
+        stats[2] = vctx->gate_last_distance.load();
+    }
+    jfloatArray result = env->NewFloatArray(3);
+    env->SetFloatArrayRegion(result, 0, 3, stats);
+    return result;
+}
+
+// Longest side worth keeping a frame at: what the encoder rescales images to (0 if unknown)
+JNIEXPORT jint JNICALL
+Java_com_example_visionai_inference_LlamaModel_encoderInputSize(
+        JNIEnv * /* env */, jobject /* thiz */, jlong ctx_ptr) {
+    auto * vctx = reinterpret_cast<VisionAIContext *>(ctx_ptr);
+    if (!vctx) {
+        return 0;
+    }
+    return vctx->encoder_preproc_size > 0 ? vctx->encoder_preproc_size : vctx->encoder_image_size;
+}
+
+// Content hash of a frame, the same key encodeImage stores with its embedding
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_hashImage(
+        JNIEnv * env, jobject /* thiz */, jobject image_buffer, jint width, jint height) {
+
+    std::vector<unsigned char> rgb;
+    if (!rgb_from_buffer(env, image_buffer, width, height, rgb)) {
+        return 0;
+    }
+    return (jlong) hash_image(rgb.data(), (uint32_t) width, (uint32_t) height);
+}
+
+// Pick up to `count` keyframes out of a dense run of decoded video frames (RGBA_8888 Bitmaps)
+// by appearance change, so near-duplicates never reach the encoder; ascending frame indices
+JNIEXPORT jintArray JNICALL
+Java_com_example_visionai_inference_LlamaModel_selectKeyframes(
+        JNIEnv * env, jobject /* thiz */, jobjectArray frames, jint count) {
 
+    auto t_start = steady_clock::now();
+    const int n_frames = env->GetArrayLength(frames);
+    std::vector<FrameSignature> sigs(n_frames);
     for (int i = 0; i < n_frames; i++) {
-        mtmd_bitmap_free(bitmaps[i]);
-        env->ReleaseByteArrayElements(frame_refs[i], frame_ptrs[i], JNI_ABORT);
+        jobject bitmap = env->GetObjectArrayElement(frames, i);
+        AndroidBitmapInfo info;
+        void * pixels = nullptr;
+        const bool locked = AndroidBitmap_getInfo(env, bitmap, &info) == ANDROID_BITMAP_RESULT_SUCCESS &&
+                            info.format == ANDROID_BITMAP_FORMAT_RGBA_8888 &&
+                            AndroidBitmap_lockPixels(env, bitmap, &pixels) == ANDROID_BITMAP_RESULT_SUCCESS;
+        if (locked) {
+            frame_signature(sigs[i], static_cast<const uint8_t *>(pixels),
+                            (int) info.width, (int) info.height, info.stride);
+            AndroidBitmap_unlockPixels(env, bitmap);
+        }
+        env->DeleteLocalRef(bitmap);
+        if (!locked) {
+            throw_java_exception(env, "Keyframe selection needs ARGB_8888 frames");
+            return nullptr;
+        }
     }
-    mtmd_input_chunks_free(chunks);
-    env->ReleaseIntArrayElements(widths, w_arr, JNI_ABORT);
-    env->ReleaseIntArrayElements(heights, h_arr, JNI_ABORT);
-    env->ReleaseStringUTFChars(prompt, prompt_c);
 
-    jstring jresult = env->NewStringUTF(response.c_str());
-    env->CallVoidMethod(callback, onCompleteMethod, jresult);
-    env->DeleteLocalRef(jresult);
+    std::vector<size_t> picks = select_keyframes(sigs, (size_t) std::max(0, count), KEYFRAME_MIN_CHANGE);
+    std::vector<jint> indices(picks.begin(), picks.end());
+
+    std::string picked;
+    for (jint i : indices) {
+        picked += (picked.empty() ? "" : ",") + std::to_string(i);
+    }
+    LOGI("=== KEYFRAME BENCHMARK === %d frames -> %zu keyframes [%s] | %lld us", n_frames, indices.size(),
+         picked.c_str(),
+         (long long) std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - t_start).count());
+
+    jintArray result = env->NewIntArray((jsize) indices.size());
+    env->SetIntArrayRegion(result, 0, (jsize) indices.size(), indices.data());
+    return result;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_example_visionai_inference_LlamaModel_createRequest(
+        JNIEnv * /* env */, jobject /* thiz */) {
+    return reinterpret_cast<jlong>(new Request());
+}
+
+// Safe from any thread; the running call stops within one decode step (or one image slice)
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_cancelRequest(
+        JNIEnv * /* env */, jobject /* thiz */, jlong request_ptr) {
+    auto * req = reinterpret_cast<Request *>(request_ptr);
+    if (!req) return;
+    req->cancelled = true;
+    if (req->ring) req->ring->abandon();
+}
+
+// Give a request a token ring and return its bytes as a direct ByteBuffer
+JNIEXPORT jobject JNICALL
+Java_com_example_visionai_inference_LlamaModel_attachTokenRing(
+        JNIEnv * env, jobject /* thiz */, jlong request_ptr, jint capacity) {
+    auto * req = reinterpret_cast<Request *>(request_ptr);
+    req->ring = std::make_unique<TokenRing>((size_t) capacity);
+    return env->NewDirectByteBuffer(req->ring->data(), (jlong) req->ring->capacity());
+}
+
+// Block the consumer until token bytes arrive: readable count, 0 on timeout, -1 at the end
+JNIEXPORT jint JNICALL
+Java_com_example_visionai_inference_LlamaModel_tokenRingWait(
+        JNIEnv * /* env */, jobject /* thiz */, jlong request_ptr, jint timeout_ms) {
+    auto * req = reinterpret_cast<Request *>(request_ptr);
+    return (jint) req->ring->wait_readable(timeout_ms);
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_tokenRingConsume(
+        JNIEnv * /* env */, jobject /* thiz */, jlong request_ptr, jint n_bytes) {
+    auto * req = reinterpret_cast<Request *>(request_ptr);
+    req->ring->consume((size_t) n_bytes);
+}
+
+// End the stream even if the native call never ran (e.g. cancelled before it started)
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_tokenRingClose(
+        JNIEnv * /* env */, jobject /* thiz */, jlong request_ptr) {
+    auto * req = reinterpret_cast<Request *>(request_ptr);
+    if (req && req->ring) req->ring->close();
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_freeRequest(
+        JNIEnv * /* env */, jobject /* thiz */, jlong request_ptr) {
+    delete reinterpret_cast<Request *>(request_ptr);
+}
+
+JNIEXPORT void JNICALL
+Java_com_example_visionai_inference_LlamaModel_freeImageEmbedding(
+        JNIEnv * /* env */, jobject /* thiz */, jlong embd_ptr) {
+    delete reinterpret_cast<ImageEmbedding *>(embd_ptr);
 }
 
 // Free all resources
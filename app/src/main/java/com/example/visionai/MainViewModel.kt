@@ -15,12 +15,16 @@ import android.speech.SpeechRecognizer
 import android.speech.tts.TextToSpeech
 import android.speech.tts.UtteranceProgressListener
 import android.util.Log
+import androidx.camera.core.ImageAnalysis
 import androidx.camera.core.ImageCapture
 import androidx.camera.core.ImageCaptureException
 import androidx.camera.core.ImageProxy
 import androidx.core.content.ContextCompat
 import androidx.lifecycle.AndroidViewModel
 import androidx.lifecycle.viewModelScope
+import com.example.visionai.inference.CameraFrame
+import com.example.visionai.inference.ChatSession
+import com.example.visionai.inference.ImageEmbedding
 import com.example.visionai.inference.LlamaModel
 import com.example.visionai.voice.VoiceCommand
 import com.example.visionai.voice.VoiceCommandParser
@@ -28,15 +32,24 @@ import com.google.mlkit.common.model.DownloadConditions
 import com.google.mlkit.nl.translate.TranslateLanguage
 import com.google.mlkit.nl.translate.Translation
 import com.google.mlkit.nl.translate.TranslatorOptions
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.Deferred
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.Job
+import kotlinx.coroutines.asExecutor
+import kotlinx.coroutines.async
+import kotlinx.coroutines.coroutineScope
 import kotlinx.coroutines.delay
+import kotlinx.coroutines.flow.Flow
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.first
+import kotlinx.coroutines.flow.onCompletion
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.suspendCancellableCoroutine
 import kotlinx.coroutines.tasks.await
 import kotlinx.coroutines.withContext
+import kotlinx.coroutines.withTimeoutOrNull
 import java.io.File
 import java.net.HttpURLConnection
 import java.net.URL
@@ -113,6 +126,22 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
     private var voiceFeedbackJob: Job? = null
     private var registeredContext: Context? = null
     private var registeredImageCapture: ImageCapture? = null
+    private var registeredImageAnalysis: ImageAnalysis? = null
+
+    // Encoded image/video frames of the last description, reused by Q&A follow-ups
+    private var qaEmbeddings: List<ImageEmbedding> = emptyList()
+    private var qaEmbeddingsSource: Any? = null
+    // Native conversation holding the description in its KV cache; null if none could be reserved
+    private var qaSession: ChatSession? = null
+    // Image key the session is saved under, so the same photo resumes without the model
+    private var qaSessionKey: Long? = null
+    // Continuous mode's conversation: recent frames and their answers stay in its KV cache
+    private var continuousChat: ChatSession? = null
+    // Video frames encoded and prefilled while recording, and the clip they turned out to be
+    private var ingestion: Deferred<RecordedFrames?>? = null
+    private var ingestedUri: Uri? = null
+
+    private class RecordedFrames(val chat: ChatSession, val frames: List<ImageEmbedding>)
 
     init {
         val prefs = app.getSharedPreferences(PREFS_NAME, Context.MODE_PRIVATE)
@@ -367,6 +396,23 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
         private const val MMPROJ_FILENAME = "mmproj-SmolVLM2-500M-Video-Instruct-Q8_0.gguf"
         private const val PREFS_NAME = "scenesense_prefs"
         private const val KEY_LANGUAGE = "app_language"
+        private const val SESSIONS_DIR = "sessions"
+        private const val MAX_SAVED_SESSIONS = 8
+        // Continuous frames favour latency: about one SmolVLM tile's worth of visual tokens
+        private const val CONTINUOUS_VISUAL_TOKENS = 64
+        // Clips at least this long are summarized segment by segment instead of from 3 frames
+        private const val LONG_VIDEO_MIN_MS = 15_000L
+        // Frames whose perceptual hash is this close to the last described one are not re-described
+        private const val CONTINUOUS_DUPLICATE_BITS = 6
+        private const val CONTINUOUS_DUPLICATE_DELAY_MS = 500L
+        // Continuous frames are scheduled to be described within this long of their capture;
+        // the capture stage offers a fresh frame this often, the freshest one wins
+        private const val CONTINUOUS_LATENCY_BUDGET_MS = 5000
+        private const val CONTINUOUS_CAPTURE_INTERVAL_MS = 250L
+        // Continuous frames after the first only say what changed: a short reply conditioned
+        // on the last couple of frames, older ones evicted from the context
+        private const val CONTINUOUS_CHAT_TURNS = 2
+        private const val CONTINUOUS_DELTA_TOKENS = 48
     }
 
     fun setCaptureMode(mode: CaptureMode) {
@@ -412,6 +458,7 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
     }
 
     fun onVideoSelected(uri: Uri) {
+        if (uri != ingestedUri) discardIngestion()
         updateBitmap(null)
         cleanupTempVideos(uri)
         _uiState.value = _uiState.value.copy(
@@ -470,15 +517,86 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
 
     /** Capture video and immediately start inference */
     fun onVideoCapturedAndDescribe(uri: Uri) {
+        if (ingestion != null) ingestedUri = uri
         onVideoSelected(uri)
         describe()
     }
 
     fun setRecording(recording: Boolean) {
         _uiState.value = _uiState.value.copy(isRecording = recording)
+        if (recording) startIngestion()
     }
 
-    fun startContinuous(context: Context, imageCapture: ImageCapture?) {
+    /**
+     * Encode and prefill frames of the video being recorded as they are captured, spaced like
+     * the frames the clip path samples, so that once it stops only the end of the prompt and
+     * the reply are left. Without the analysis stream the clip is decoded after recording.
+     */
+    private fun startIngestion() {
+        val imageAnalysis = registeredImageAnalysis ?: return
+        if (!llamaModel.isLoaded) return
+        discardIngestion()
+        val chat = llamaModel.createChat() ?: return
+
+        ingestion = viewModelScope.async {
+            val frames = mutableListOf<ImageEmbedding>()
+            var recorded: RecordedFrames? = null
+            try {
+                llamaModel.beginFrames(chat, LlamaModel.VIDEO_PROMPT)
+                val startNs = System.nanoTime()
+                val interval = LlamaModel.VIDEO_DURATION_MS / LlamaModel.VIDEO_NUM_FRAMES
+                for (i in 0 until LlamaModel.VIDEO_NUM_FRAMES) {
+                    val wait = i * interval - (System.nanoTime() - startNs) / 1_000_000
+                    // Woken early by the stop, which must not wait for the next frame's slot
+                    if (wait > 0) withTimeoutOrNull(wait) { _uiState.first { !it.isRecording } }
+                    if (!_uiState.value.isRecording) break
+
+                    val frame = analyzeFrame(imageAnalysis)
+                    val timestampMs = (System.nanoTime() - startNs) / 1_000_000
+                    try {
+                        frames.add(llamaModel.appendFrame(chat, frame, timestampMs))
+                    } finally {
+                        frame.bitmap.recycle()
+                    }
+                }
+                if (frames.isNotEmpty()) recorded = RecordedFrames(chat, frames)
+            } catch (e: CancellationException) {
+                throw e
+            } catch (e: Exception) {
+                Log.e("VisionAI", "Frame ingestion failed, the clip will be decoded after recording", e)
+            } finally {
+                if (recorded == null) {
+                    llamaModel.release(chat)
+                    frames.forEach { llamaModel.release(it) }
+                }
+            }
+            recorded
+        }
+    }
+
+    /** Frames ingested while the clip was recorded, once all are in; null to decode it instead */
+    private suspend fun takeIngestion(): RecordedFrames? {
+        val pending = ingestion ?: return null
+        ingestion = null
+        ingestedUri = null
+        return pending.await()
+    }
+
+    private fun discardIngestion() {
+        val pending = ingestion ?: return
+        ingestion = null
+        ingestedUri = null
+        pending.cancel()
+        viewModelScope.launch {
+            // Done before the cancel landed: nothing else will release it
+            runCatching { pending.await() }.getOrNull()?.let { recorded ->
+                llamaModel.release(recorded.chat)
+                recorded.frames.forEach { llamaModel.release(it) }
+            }
+        }
+    }
+
+    fun startContinuous(context: Context, imageCapture: ImageCapture?, imageAnalysis: ImageAnalysis?) {
         if (imageCapture == null || !llamaModel.isLoaded) return
         if (continuousJob?.isActive == true) return
 
@@ -490,97 +608,242 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
             errorMessage = null
         )
 
+        llamaModel.resetChangeGate()
         continuousJob = viewModelScope.launch {
             var count = 0
+            // Shown text of the last frame the model described
+            var describedText = ""
+            var pixelSkipped = 0
+            // Frames still in the pipeline by id with their hashes, for display once described:
+            // at most the one being encoded (or waiting to be described) and the pending one.
+            // Both stages run on the main dispatcher.
+            val submitted = HashMap<Long, Pair<Bitmap, Long>>()
+            // Hash of the frame the pipeline last delivered, described or held back by the gate
+            var deliveredHash: Long? = null
+            val pipeline = llamaModel.startPipeline(CONTINUOUS_VISUAL_TOKENS, CONTINUOUS_LATENCY_BUDGET_MS)
             try {
-                while (_uiState.value.isContinuousRunning) {
-                    count++
+                coroutineScope {
+                    // Capture stage: keep offering the freshest frame to the native encoder
+                    // thread, never waiting on the describe stage; newer frames replace ones the
+                    // encoder has not started
+                    val capture = launch {
+                        var nextId = 1L
+                        while (_uiState.value.isContinuousRunning) {
+                            val capturedNs = System.nanoTime()
+                            // Prefer the YUV analysis stream: one native pass yields the 512px frame
+                            val frame = imageAnalysis?.let { analyzeFrame(it) }
+                            val scaled = frame?.bitmap ?: run {
+                                val bitmap = captureFrame(context, imageCapture)
+                                scaleBitmap(bitmap, maxDim = 512).also { if (it !== bitmap) bitmap.recycle() }
+                            }
 
-                    _uiState.value = _uiState.value.copy(
-                        inferenceState = InferenceState.RUNNING,
-                        responseText = "Capturando frame $count...",
-                        translatedText = ""
-                    )
+                            // Same pixels as a frame that was described or is still on its way
+                            // there: not worth encoding. Dropped frames no longer count, so the
+                            // scene they showed is offered again.
+                            val hash = frame?.hash ?: llamaModel.frameHash(scaled)
+                            val seen = listOfNotNull(deliveredHash) + submitted.values.map { it.second }
+                            if (seen.any { LlamaModel.hashDistance(hash, it) <= CONTINUOUS_DUPLICATE_BITS }) {
+                                pixelSkipped++
+                                frame?.let { llamaModel.release(it) }
+                                scaled.recycle()
+                                delay(CONTINUOUS_DUPLICATE_DELAY_MS)
+                                continue
+                            }
 
-                    val bitmap = captureFrame(context, imageCapture)
-                    if (!_uiState.value.isContinuousRunning) {
-                        bitmap.recycle()
-                        break
+                            val id = nextId++
+                            submitted[id] = scaled to hash
+                            val oldest = if (frame != null) {
+                                llamaModel.submit(pipeline, frame, id, capturedNs)
+                            } else {
+                                llamaModel.submit(pipeline, scaled, id, capturedNs)
+                            }
+                            if (oldest == 0L) {
+                                submitted.remove(id)?.first?.recycle()
+                                break
+                            }
+                            // Replaced before the encoder took them, or dropped as stale
+                            submitted.keys.filter { it < oldest }.forEach { submitted.remove(it)?.first?.recycle() }
+                            delay(CONTINUOUS_CAPTURE_INTERVAL_MS)
+                        }
                     }
 
-                    val scaled = scaleBitmap(bitmap, maxDim = 512)
-                    if (scaled !== bitmap) bitmap.recycle()
+                    // Describe stage: frames arrive encoded while the next one is captured and encoded
+                    while (_uiState.value.isContinuousRunning) {
+                        val next = llamaModel.nextEncoded(pipeline)
+                        val embedding = next.embedding
+                        val entry = submitted.remove(next.id)
+                        if (entry == null) {
+                            embedding?.let { llamaModel.release(it) }
+                            continue
+                        }
+                        val (scaled, hash) = entry
+                        deliveredHash = hash
+                        // Anything older never made it through the schedule
+                        submitted.keys.filter { it < next.id }.forEach { submitted.remove(it)?.first?.recycle() }
+                        count++
 
-                    // Keep one copy for UI state, another for inference.
-                    // describeImage() internally re-scales to 384px and recycles
-                    // the bitmap we pass in, so we can't share the same object.
-                    val forInference = scaled.copy(scaled.config ?: Bitmap.Config.ARGB_8888, false)
+                        updateBitmap(scaled)
+                        _uiState.value = _uiState.value.copy(
+                            selectedBitmap = scaled,
+                            selectedVideoUri = null,
+                            inferenceState = InferenceState.RUNNING,
+                            responseText = "Analizando frame $count...",
+                            translatedText = "",
+                            errorMessage = null
+                        )
 
-                    updateBitmap(scaled)
-                    _uiState.value = _uiState.value.copy(
-                        selectedBitmap = scaled,
-                        selectedVideoUri = null,
-                        responseText = "Analizando frame $count...",
-                        errorMessage = null
-                    )
+                        // Same scene as the last described frame as far as the encoder can
+                        // tell: keep its answer and skip the LLM
+                        if (embedding == null) {
+                            Log.i("VisionAI", "Frame $count unchanged, kept the last description")
+                            _uiState.value = _uiState.value.copy(
+                                inferenceState = InferenceState.DONE,
+                                responseText = describedText,
+                                continuousCount = count
+                            )
+                            continue
+                        }
 
-                    val response = llamaModel.describeImage(
-                        forInference,
-                        prompt = "Describe this image."
-                    )
+                        val response = try {
+                            describeContinuousFrame(embedding)
+                        } finally {
+                            llamaModel.release(embedding)
+                        }
+                        Log.i("VisionAI", "Frame $count used ${llamaModel.lastVisualTokens} visual tokens")
 
-                    if (!_uiState.value.isContinuousRunning) break
+                        if (!_uiState.value.isContinuousRunning) break
 
-                    val isSpanish = _uiState.value.language == AppLanguage.SPANISH
-                    val displayResponse = if (isSpanish) {
-                        translateEnToEs(response) ?: response
-                    } else response
+                        // Nothing worth saying changed: keep the last answer on screen, stay quiet
+                        if (response.trim().startsWith("No change", ignoreCase = true)) {
+                            _uiState.value = _uiState.value.copy(
+                                inferenceState = InferenceState.DONE,
+                                responseText = describedText,
+                                continuousCount = count
+                            )
+                            llamaModel.complete(pipeline)
+                            continue
+                        }
 
-                    _uiState.value = _uiState.value.copy(
-                        inferenceState = InferenceState.DONE,
-                        responseText = "[Frame $count] $displayResponse",
-                        continuousCount = count
-                    )
+                        val isSpanish = _uiState.value.language == AppLanguage.SPANISH
+                        val displayResponse = if (isSpanish) {
+                            translateEnToEs(response) ?: response
+                        } else response
 
-                    // Auto-speak the result for hands-free navigation
-                    val toSpeak = displayResponse.trim()
-                    if (toSpeak.isNotEmpty()) {
-                        if (_uiState.value.isVoiceCommandMode) {
-                            voiceAwareSpeak(toSpeak, "continuous_$count")
-                        } else {
-                            tts?.speak(toSpeak, TextToSpeech.QUEUE_FLUSH, null, "continuous_$count")
+                        describedText = "[Frame $count] $displayResponse"
+                        _uiState.value = _uiState.value.copy(
+                            inferenceState = InferenceState.DONE,
+                            responseText = describedText,
+                            continuousCount = count
+                        )
+                        val describedNs = System.nanoTime()
+
+                        // Auto-speak the result for hands-free navigation
+                        val toSpeak = displayResponse.trim()
+                        if (toSpeak.isNotEmpty()) {
+                            if (_uiState.value.isVoiceCommandMode) {
+                                voiceAwareSpeak(toSpeak, "continuous_$count")
+                            } else {
+                                tts?.speak(toSpeak, TextToSpeech.QUEUE_FLUSH, null, "continuous_$count")
+                            }
                         }
-                    }
 
-                    // Wait for TTS to finish before capturing next frame
-                    val ttsTimeout = 30_000L // max wait 30s
-                    val startWait = System.currentTimeMillis()
-                    while (_uiState.value.isSpeaking &&
-                        System.currentTimeMillis() - startWait < ttsTimeout &&
-                        _uiState.value.isContinuousRunning
-                    ) {
-                        delay(200)
-                    }
-                    // Small pause after TTS finishes for natural pacing
-                    if (_uiState.value.isContinuousRunning) {
-                        delay(500)
+                        // Wait for TTS to finish before describing the next frame
+                        val ttsTimeout = 30_000L // max wait 30s
+                        val startWait = System.currentTimeMillis()
+                        while (_uiState.value.isSpeaking &&
+                            System.currentTimeMillis() - startWait < ttsTimeout &&
+                            _uiState.value.isContinuousRunning
+                        ) {
+                            delay(200)
+                        }
+                        // Small pause after TTS finishes for natural pacing
+                        if (_uiState.value.isContinuousRunning) {
+                            delay(500)
+                        }
+                        // The stage is free again: the scheduler plans the next frame around it
+                        llamaModel.complete(pipeline, describedNs)
                     }
+                    capture.cancel()
                 }
+            } catch (e: CancellationException) {
+                // Stopped mid-frame: the native requests were aborted with the job
+                _uiState.value = _uiState.value.copy(inferenceState = InferenceState.IDLE)
             } catch (e: Exception) {
                 Log.e("VisionAI", "Continuous mode error at frame $count", e)
                 _uiState.value = _uiState.value.copy(
                     inferenceState = InferenceState.ERROR,
                     errorMessage = "Error frame $count: ${e.message}"
                 )
+            } finally {
+                // Both stages have returned from native code by now
+                if (count > 0) {
+                    val stats = llamaModel.pipelineStats(pipeline)
+                    Log.i(
+                        "VisionAI", "Continuous latency p50/p90/p99: ${stats.p50Ms.toInt()}/${stats.p90Ms.toInt()}/" +
+                            "${stats.p99Ms.toInt()} ms over ${stats.described} frames " +
+                            "(budget $CONTINUOUS_LATENCY_BUDGET_MS ms), ${stats.dropped} dropped as stale, " +
+                            "${stats.downgraded} with fewer visual tokens"
+                    )
+                }
+                llamaModel.release(pipeline)
+                submitted.values.forEach { it.first.recycle() }
+                submitted.clear()
+                continuousChat?.let { llamaModel.release(it) }
+                continuousChat = null
             }
 
+            if (count + pixelSkipped > 0) {
+                val gate = llamaModel.changeGateStats()
+                Log.i(
+                    "VisionAI", "Continuous dedup: ${count + pixelSkipped} frames, $pixelSkipped skipped by " +
+                        "pixel hash, ${gate.skipped} of ${gate.frames} by the encoder gate"
+                )
+            }
             _uiState.value = _uiState.value.copy(isContinuousRunning = false)
             continuousJob = null
         }
     }
 
+    /**
+     * Describe one continuous frame. The first is described in full in [continuousChat]; later
+     * ones are follow-up turns that only ask what changed, with the chat keeping the last few
+     * frames and their answers and evicting older ones.
+     */
+    private suspend fun describeContinuousFrame(embedding: ImageEmbedding): String {
+        val text = StringBuilder()
+        continuousChat?.let { chat ->
+            try {
+                llamaModel.askStreaming(chat, LlamaModel.DELTA_PROMPT, listOf(embedding))
+                    .collect { text.append(it) }
+                return text.toString()
+            } catch (e: CancellationException) {
+                throw e
+            } catch (e: Exception) {
+                // Turn failed (e.g. context full): start over with a full description
+                Log.w("VisionAI", "Delta turn failed, restarting the continuous chat", e)
+                llamaModel.release(chat)
+                continuousChat = null
+                text.clear()
+            }
+        }
+
+        val chat = llamaModel.createChat()
+        if (chat == null) {
+            llamaModel.describeEmbeddingsStreaming(listOf(embedding), LlamaModel.IMAGE_PROMPT)
+                .collect { text.append(it) }
+            return text.toString()
+        }
+        continuousChat = chat
+        llamaModel.limitChat(chat, CONTINUOUS_CHAT_TURNS)
+        llamaModel.startChatStreaming(chat, listOf(embedding), LlamaModel.IMAGE_PROMPT)
+            .collect { text.append(it) }
+        llamaModel.limitChat(chat, CONTINUOUS_CHAT_TURNS, CONTINUOUS_DELTA_TOKENS)
+        return text.toString()
+    }
+
     fun stopContinuous() {
         _uiState.value = _uiState.value.copy(isContinuousRunning = false)
+        continuousJob?.cancel()
     }
 
     private suspend fun captureFrame(
@@ -591,6 +854,12 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
             ContextCompat.getMainExecutor(context),
             object : ImageCapture.OnImageCapturedCallback() {
                 override fun onCaptureSuccess(imageProxy: ImageProxy) {
+                    val decoded = decodePhoto(imageProxy)
+                    if (decoded != null) {
+                        imageProxy.close()
+                        cont.resume(decoded)
+                        return
+                    }
                     val bitmap = imageProxy.toBitmap()
                     val rotation = imageProxy.imageInfo.rotationDegrees
                     val rotated = if (rotation != 0) {
@@ -612,6 +881,32 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
         )
     }
 
+    /** Captured JPEG decoded natively at model size, or null to decode it through a Bitmap */
+    fun decodePhoto(imageProxy: ImageProxy): Bitmap? =
+        llamaModel.decodeFrame(imageProxy)?.let { frame ->
+            llamaModel.release(frame)
+            frame.bitmap
+        }
+
+    /** Next ImageAnalysis frame, rotated, scaled and converted from YUV in native code */
+    private suspend fun analyzeFrame(
+        imageAnalysis: ImageAnalysis
+    ): CameraFrame = suspendCancellableCoroutine { cont ->
+        imageAnalysis.setAnalyzer(Dispatchers.Default.asExecutor()) { imageProxy ->
+            imageAnalysis.clearAnalyzer()
+            val frame = try {
+                llamaModel.convertFrame(imageProxy)
+            } catch (e: Exception) {
+                cont.resumeWithException(e)
+                return@setAnalyzer
+            } finally {
+                imageProxy.close()
+            }
+            cont.resume(frame)
+        }
+        cont.invokeOnCancellation { imageAnalysis.clearAnalyzer() }
+    }
+
     fun describe() {
         val state = _uiState.value
         if (!llamaModel.isLoaded) return
@@ -764,7 +1059,14 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
                 val accumulated = StringBuilder()
                 var sentencesSpoken = 0
 
-                llamaModel.describeImageStreaming(bitmap).collect { token ->
+                val key = if (!isContinuous) llamaModel.imageKey(bitmap) else null
+                if (key != null && resumeSavedChat(key, bitmap, isSpanish)) return@launch
+
+                val embedding = llamaModel.encode(bitmap)
+                replaceQaEmbeddings(listOf(embedding), bitmap)
+                qaSessionKey = key
+
+                describeFlow(listOf(embedding), LlamaModel.IMAGE_PROMPT).collect { token ->
                     accumulated.append(token)
                     val currentText = accumulated.toString()
                     if (!isSpanish) {
@@ -820,6 +1122,7 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
                         voiceAwareSpeak(response, "voice_describe")
                     }
                 }
+                persistQaSession()
             } catch (e: Exception) {
                 _uiState.value = _uiState.value.copy(
                     inferenceState = InferenceState.ERROR,
@@ -846,13 +1149,44 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
                 qaInputText = ""
             )
             try {
-                val retriever = MediaMetadataRetriever()
-                retriever.setDataSource(app, uri)
-
                 val accumulated = StringBuilder()
                 var sentencesSpoken = 0
 
-                llamaModel.describeVideoStreaming(uri, retriever).collect { token ->
+                val retriever = MediaMetadataRetriever()
+                retriever.setDataSource(app, uri)
+                val durationMs = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_DURATION)
+                    ?.toLongOrNull() ?: 0L
+                val isLong = durationMs >= LONG_VIDEO_MIN_MS
+                // Frames ingested while recording only cover the clip's first seconds
+                if (isLong) discardIngestion()
+
+                val recorded = if (uri == ingestedUri) takeIngestion() else null
+                val flow = if (isLong) {
+                    // Too long for one context: caption it segment by segment, then summarize.
+                    // Follow-up questions go back to the clip's first frames.
+                    replaceQaEmbeddings(emptyList(), uri)
+                    llamaModel.describeLongVideoStreaming(retriever) { index, count, _ ->
+                        _uiState.value = _uiState.value.copy(
+                            responseText = "Analizando segmento ${index + 1}/$count..."
+                        )
+                    }.onCompletion { retriever.release() }
+                } else if (recorded != null) {
+                    // Frames went into the KV cache while recording: only the end of the turn is left
+                    retriever.release()
+                    replaceQaEmbeddings(recorded.frames, uri)
+                    qaSession = recorded.chat
+                    llamaModel.finishFramesStreaming(recorded.chat)
+                } else {
+                    val frames = try {
+                        llamaModel.encodeVideo(retriever)
+                    } finally {
+                        retriever.release()
+                    }
+                    replaceQaEmbeddings(frames, uri)
+                    describeFlow(frames, LlamaModel.VIDEO_PROMPT)
+                }
+
+                flow.collect { token ->
                     accumulated.append(token)
                     val currentText = accumulated.toString()
                     if (!isSpanish) {
@@ -881,7 +1215,6 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
                     }
                 }
 
-                retriever.release()
                 val response = accumulated.toString()
 
                 if (isSpanish) {
@@ -976,7 +1309,15 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
                 val accumulated = StringBuilder()
                 var sentencesSpoken = 0
 
-                val flow = if (state.selectedVideoUri != null) {
+                val currentSource: Any? = state.selectedVideoUri ?: state.selectedBitmap
+                val session = qaSession
+                val flow = if (session != null && qaEmbeddingsSource == currentSource) {
+                    // Description and earlier turns are still in the session's KV cache
+                    llamaModel.askStreaming(session, questionEn)
+                } else if (qaEmbeddings.isNotEmpty() && qaEmbeddingsSource == currentSource) {
+                    // Image already encoded by the initial description: skip the vision encoder
+                    llamaModel.describeEmbeddingsStreaming(qaEmbeddings, qaPrompt)
+                } else if (state.selectedVideoUri != null) {
                     val retriever = MediaMetadataRetriever()
                     retriever.setDataSource(app, state.selectedVideoUri)
                     llamaModel.describeVideoStreaming(state.selectedVideoUri, retriever, prompt = qaPrompt)
@@ -1033,6 +1374,9 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
                 if (_uiState.value.isVoiceCommandMode && sentencesSpoken == 0) {
                     voiceAwareSpeak(displayText, "voice_qa")
                 }
+                if (session != null && qaEmbeddingsSource == currentSource) {
+                    persistQaSession()
+                }
             } catch (e: Exception) {
                 Log.e("VisionAI", "Q&A follow-up failed", e)
                 _uiState.value = _uiState.value.copy(
@@ -1059,9 +1403,10 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
 
     // ── Voice Command Mode ──────────────────────────────────────────
 
-    fun registerCaptureRefs(context: Context, imageCapture: ImageCapture?) {
+    fun registerCaptureRefs(context: Context, imageCapture: ImageCapture?, imageAnalysis: ImageAnalysis?) {
         registeredContext = context
         registeredImageCapture = imageCapture
+        registeredImageAnalysis = imageAnalysis
     }
 
     fun toggleVoiceCommandMode() {
@@ -1243,7 +1588,7 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
                     Log.e("VisionAI", "MODE_CONTINUOUS: refs not registered ctx=$ctx capture=$capture")
                     return
                 }
-                startContinuous(ctx, capture)
+                startContinuous(ctx, capture, registeredImageAnalysis)
             }
             VoiceCommand.REPEAT -> {
                 val text = state.responseText.trim()
@@ -1294,6 +1639,69 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
         }
     }
 
+    /** Swap in the embeddings of a new description, releasing the previous ones and their chat */
+    private fun replaceQaEmbeddings(embeddings: List<ImageEmbedding>, source: Any?) {
+        qaSession?.let { llamaModel.release(it) }
+        qaSession = null
+        qaSessionKey = null
+        qaEmbeddings.forEach { llamaModel.release(it) }
+        qaEmbeddings = embeddings
+        qaEmbeddingsSource = source
+    }
+
+    /** Describe through a native chat session so follow-ups can extend it; one-shot if none is free */
+    private fun describeFlow(embeddings: List<ImageEmbedding>, prompt: String): Flow<String> {
+        val session = llamaModel.createChat() ?: return llamaModel.describeEmbeddingsStreaming(embeddings, prompt)
+        qaSession = session
+        return llamaModel.startChatStreaming(session, embeddings, prompt)
+    }
+
+    private fun sessionFile(key: Long) =
+        File(File(app.filesDir, SESSIONS_DIR), "%016x.kv".format(key))
+
+    /** Save the current chat under its image key, keeping only the newest few on disk */
+    private suspend fun persistQaSession() {
+        val session = qaSession ?: return
+        val file = sessionFile(qaSessionKey ?: return)
+        file.parentFile?.mkdirs()
+        if (!llamaModel.saveChat(session, file)) return
+        file.parentFile?.listFiles { f -> f.name.endsWith(".kv") }
+            ?.sortedByDescending { it.lastModified() }
+            ?.drop(MAX_SAVED_SESSIONS)
+            ?.forEach { it.delete() }
+    }
+
+    /** Show the chat saved for this image, if any, without running the encoder or prefill */
+    private suspend fun resumeSavedChat(key: Long, bitmap: Bitmap, isSpanish: Boolean): Boolean {
+        val session = llamaModel.restoreChat(sessionFile(key), key) ?: return false
+        replaceQaEmbeddings(emptyList(), bitmap)
+        qaSession = session
+        qaSessionKey = key
+
+        // First user turn is the image prompt; after it come the description and Q&A turns
+        val messages = llamaModel.history(session).drop(1).mapIndexed { i, (role, text) ->
+            val chatRole = when {
+                i == 0 -> ChatRole.SYSTEM_DESCRIPTION
+                role == "user" -> ChatRole.USER_QUESTION
+                else -> ChatRole.ASSISTANT_ANSWER
+            }
+            val translated = if (isSpanish && role == "assistant") translateEnToEs(text) ?: text else ""
+            ChatMessage(chatRole, text, translatedText = translated)
+        }
+        val last = messages.last()
+        val displayText = if (isSpanish) last.translatedText.ifEmpty { last.text } else last.text
+        _uiState.value = _uiState.value.copy(
+            inferenceState = InferenceState.DONE,
+            responseText = displayText,
+            chatMessages = messages,
+            qaCount = messages.count { it.role == ChatRole.USER_QUESTION }
+        )
+        if (_uiState.value.isVoiceCommandMode) {
+            voiceAwareSpeak(displayText, "voice_describe")
+        }
+        return true
+    }
+
     private fun scaleBitmap(bitmap: Bitmap, maxDim: Int): Bitmap {
         val w = bitmap.width
         val h = bitmap.height
@@ -1315,8 +1723,11 @@ class MainViewModel(private val app: Application) : AndroidViewModel(app) {
         tts = null
         registeredContext = null
         registeredImageCapture = null
+        registeredImageAnalysis = null
         updateBitmap(null)
         cleanupTempVideos()
+        discardIngestion()
+        replaceQaEmbeddings(emptyList(), null)
         llamaModel.free()
         enToEsTranslator?.close()
         esEnTranslator?.close()
@@ -0,0 +1,51 @@
+package com.example.visionai.inference
+
+import android.graphics.Bitmap
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Reusable direct buffers for frames handed to native code. Native reads them in place through
+ * GetDirectBufferAddress, so a frame costs one copy out of the Bitmap and no Java arrays.
+ */
+internal class FrameBufferPool(private val maxPooled: Int = 4) {
+
+    private val free = ArrayDeque<ByteBuffer>()
+
+    /** Copy a bitmap's RGBA_8888 pixels into a pooled buffer; hand it back with [release] */
+    fun copyOf(bitmap: Bitmap): ByteBuffer {
+        val argb = if (bitmap.config != Bitmap.Config.ARGB_8888) {
+            bitmap.copy(Bitmap.Config.ARGB_8888, false)
+        } else {
+            bitmap
+        }
+
+        val buffer = acquire(argb.width * argb.height * 4)
+        argb.copyPixelsToBuffer(buffer)
+        buffer.rewind()
+
+        if (argb !== bitmap) {
+            argb.recycle()
+        }
+        return buffer
+    }
+
+    @Synchronized
+    fun release(buffer: ByteBuffer) {
+        if (free.size < maxPooled) {
+            free.addLast(buffer)
+        }
+    }
+
+    /** Empty buffer of at least [size] bytes for native code to fill; hand it back with [release] */
+    @Synchronized
+    fun acquire(size: Int): ByteBuffer {
+        val pooled = free.firstOrNull { it.capacity() >= size }
+        if (pooled != null) {
+            free.remove(pooled)
+            pooled.clear()
+            return pooled
+        }
+        return ByteBuffer.allocateDirect(size).order(ByteOrder.nativeOrder())
+    }
+}
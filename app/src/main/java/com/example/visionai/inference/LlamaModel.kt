@@ -1,16 +1,28 @@
 package com.example.visionai.inference
 
 import android.graphics.Bitmap
+import android.graphics.ImageFormat
+import android.graphics.Rect
 import android.media.MediaMetadataRetriever
 import android.net.Uri
 import android.util.Log
+import androidx.camera.core.ImageProxy
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.CoroutineStart
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.awaitCancellation
 import kotlinx.coroutines.channels.awaitClose
+import kotlinx.coroutines.channels.trySendBlocking
+import kotlinx.coroutines.coroutineScope
 import kotlinx.coroutines.flow.Flow
 import kotlinx.coroutines.flow.callbackFlow
+import kotlinx.coroutines.flow.emitAll
+import kotlinx.coroutines.flow.flow
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
 import java.io.File
+import java.nio.ByteBuffer
+import java.util.concurrent.atomic.AtomicBoolean
 
 interface TokenCallback {
     fun onToken(token: String)
@@ -18,13 +30,61 @@ interface TokenCallback {
     fun onError(error: String)
 }
 
+/** Image already run through the vision encoder; reusable until released */
+class ImageEmbedding internal constructor(internal var handle: Long)
+
+/**
+ * Camera frame converted natively: [bitmap] is for display, its pixels feed [LlamaModel.describeFrame].
+ * [hash] is its perceptual hash, see [LlamaModel.frameHash].
+ */
+class CameraFrame internal constructor(val bitmap: Bitmap, internal var pixels: ByteBuffer?, val hash: Long)
+
+/** Continuous-mode change gate counters since its last reset; [lastDistance] is a cosine distance */
+data class ChangeGateStats(val frames: Int, val skipped: Int, val lastDistance: Float)
+
+/** Native continuous-mode pipeline: frames are encoded on a worker thread while the previous one is described */
+class ContinuousPipeline internal constructor(internal var handle: Long)
+
+/** Frame [id] as given to [LlamaModel.submit]; [embedding] is null when the change gate held it back */
+class PipelineFrame internal constructor(val id: Long, val embedding: ImageEmbedding?)
+
+/**
+ * Continuous-pipeline latency from capture to finished description over recent frames, and
+ * how many frames were described, dropped as stale, or run with a reduced token budget
+ */
+data class PipelineStats(
+    val p50Ms: Float, val p90Ms: Float, val p99Ms: Float,
+    val described: Int, val dropped: Int, val downgraded: Int
+)
+
+/** Multi-turn conversation whose KV cache stays resident in native memory between turns */
+class ChatSession internal constructor(internal var handle: Long)
+
 class LlamaModel {
 
     companion object {
         private const val TAG = "VisionAI"
-        private const val VIDEO_DURATION_MS = 3000L
-        private const val VIDEO_NUM_FRAMES = 3
+        const val VIDEO_DURATION_MS = 3000L
+        const val VIDEO_NUM_FRAMES = 3
+        private const val VIDEO_CANDIDATE_FRAMES = 12
+        // Long-video mode: segment length, frames per segment, and captions folded together
+        const val LONG_VIDEO_SEGMENT_MS = 10_000L
+        const val LONG_VIDEO_SEGMENT_FRAMES = 3
+        const val LONG_VIDEO_GROUP = 6
+        private const val MIN_FRAME_VISUAL_TOKENS = 32
+        private const val CHANGE_GATE_THRESHOLD = 0.03f
         private const val FRAME_MAX_DIM = 512
+        private const val TOKEN_RING_BYTES = 16 * 1024
+        private const val TOKEN_RING_WAIT_MS = 100
+
+        /** Bits in which two perceptual hashes differ; a few means the same scene */
+        fun hashDistance(a: Long, b: Long): Int = (a xor b).countOneBits()
+
+        const val IMAGE_PROMPT = "Describe this image."
+        const val VIDEO_PROMPT = "What is the main action or notable event happening in this segment? Describe it in one brief sentence."
+        const val SEGMENT_PROMPT = "What happens in these frames? Answer in one short sentence."
+        const val SUMMARY_PROMPT = "These are timestamped descriptions of consecutive parts of one video. Summarize what happens in the video in a few sentences, in order."
+        const val DELTA_PROMPT = "What changed compared with the previous image? Answer in one short sentence, or say \"No change.\" if nothing important did."
 
         init {
             System.loadLibrary("visionai")
@@ -32,6 +92,40 @@ class LlamaModel {
     }
 
     private var nativePtr: Long = 0L
+    private val framePool = FrameBufferPool()
+
+    // Frames are kept no larger than the encoder rescales them to; native code then resizes
+    // once to its exact input geometry
+    private var frameMaxDim = FRAME_MAX_DIM
+
+    /**
+     * Visual tokens of the last request's images, as prefilled or as encoded for [encodeIfChanged]
+     * and [appendFrame]. Non-causal and M-RoPE decoders cannot merge tokens, so this may exceed
+     * the maxVisualTokens that was asked for.
+     */
+    @Volatile
+    var lastVisualTokens: Int = 0
+        private set
+
+    /**
+     * Share of each image's visual tokens kept for prefill; below 1 the most similar ones are
+     * merged after encoding. Applies to images encoded after it is set.
+     */
+    var visualTokenKeepRatio: Float = 1f
+        set(value) {
+            field = value.coerceIn(0f, 1f)
+            if (nativePtr != 0L) setVisualTokenKeepRatio(nativePtr, field)
+        }
+
+    /**
+     * Cosine distance between pooled frame embeddings from which [encodeIfChanged] treats a
+     * frame as a new scene; lower re-describes on smaller changes
+     */
+    var changeGateThreshold: Float = CHANGE_GATE_THRESHOLD
+        set(value) {
+            field = value.coerceIn(0f, 2f)
+            if (nativePtr != 0L) setChangeGateThreshold(nativePtr, field)
+        }
 
     val isLoaded: Boolean get() = nativePtr != 0L
 
@@ -49,41 +143,252 @@ class LlamaModel {
         }
 
         nativePtr = loadModel(modelPath, mmprojPath, nThreads, contextSize)
+        val encoderDim = encoderInputSize(nativePtr)
+        frameMaxDim = if (encoderDim > 0) minOf(FRAME_MAX_DIM, encoderDim) else FRAME_MAX_DIM
+        setVisualTokenKeepRatio(nativePtr, visualTokenKeepRatio)
+        setChangeGateThreshold(nativePtr, changeGateThreshold)
     }
 
-    /** Single image inference */
+    /**
+     * Single image inference; [maxVisualTokens] > 0 merges the image down to that many tokens
+     * where the decoder allows it, see [lastVisualTokens]
+     */
     suspend fun describeImage(
         bitmap: Bitmap,
-        prompt: String = "Describe this image."
+        prompt: String = IMAGE_PROMPT,
+        maxVisualTokens: Int = 0
     ): String = withContext(Dispatchers.IO) {
         require(nativePtr != 0L) { "Model not loaded" }
-        val scaled = scaleBitmap(bitmap, FRAME_MAX_DIM)
-        val rgbBytes = bitmapToRgb(scaled)
-        val result = runInference(nativePtr, rgbBytes, scaled.width, scaled.height, prompt)
+        val scaled = scaleBitmap(bitmap, frameMaxDim)
+        val frame = framePool.copyOf(scaled)
+        val width = scaled.width
+        val height = scaled.height
+        if (scaled !== bitmap) scaled.recycle()
+        try {
+            cancellable { request -> runInference(nativePtr, request, frame, width, height, prompt, maxVisualTokens) }
+        } finally {
+            framePool.release(frame)
+        }
+    }
+
+    /**
+     * Upright, model-sized frame from a YUV_420_888 camera image. Rotation, downscale and colour
+     * conversion happen in one native pass, with no full-resolution Bitmap in between.
+     */
+    fun convertFrame(image: ImageProxy): CameraFrame {
+        val rotation = image.imageInfo.rotationDegrees
+        val upright = rotation % 180 == 0
+        val rotW = if (upright) image.width else image.height
+        val rotH = if (upright) image.height else image.width
+        val scale = minOf(1f, frameMaxDim.toFloat() / maxOf(rotW, rotH))
+        val width = (rotW * scale).toInt()
+        val height = (rotH * scale).toInt()
+
+        val (y, u, v) = image.planes
+        val pixels = framePool.acquire(width * height * 4)
+        val hash = try {
+            yuvToRgba(
+                y.buffer, u.buffer, v.buffer,
+                y.rowStride, u.rowStride, u.pixelStride,
+                image.width, image.height, rotation,
+                pixels, width, height
+            )
+        } catch (e: Exception) {
+            framePool.release(pixels)
+            throw e
+        }
+
+        val bitmap = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888)
+        bitmap.copyPixelsFromBuffer(pixels)
+        pixels.rewind()
+        return CameraFrame(bitmap, pixels, hash)
+    }
+
+    /**
+     * Model-sized frame from a captured JPEG, decoded natively at reduced scale so the full
+     * resolution image never exists. Null when the platform decoder is unavailable (API < 30)
+     * or rejects the data; decode through a Bitmap then.
+     */
+    fun decodeFrame(image: ImageProxy): CameraFrame? {
+        if (image.format != ImageFormat.JPEG) return null
+        val jpeg = image.planes[0].buffer
+        val pixels = framePool.acquire(frameMaxDim * frameMaxDim * 4)
+        val dims = IntArray(2)
+        if (!decodeImage(jpeg, jpeg.limit(), image.imageInfo.rotationDegrees, frameMaxDim, pixels, dims)) {
+            framePool.release(pixels)
+            return null
+        }
+
+        val bitmap = Bitmap.createBitmap(dims[0], dims[1], Bitmap.Config.ARGB_8888)
+        bitmap.copyPixelsFromBuffer(pixels)
+        pixels.rewind()
+        return CameraFrame(bitmap, pixels, perceptualHash(bitmap))
+    }
+
+    /**
+     * Encoder-only change gate for continuous mode: encode [frame], releasing it, and return the
+     * embedding if the scene differs from the last frame let through, or null if it does not,
+     * in which case the LLM need not run. The first frame after [resetChangeGate] always passes.
+     */
+    suspend fun encodeIfChanged(frame: CameraFrame, maxVisualTokens: Int = 0): ImageEmbedding? {
+        require(nativePtr != 0L) { "Model not loaded" }
+        val pixels = requireNotNull(frame.pixels) { "Frame already released" }
+        try {
+            return gate(pixels, frame.bitmap.width, frame.bitmap.height, maxVisualTokens)
+        } finally {
+            release(frame)
+        }
+    }
+
+    /** [encodeIfChanged] for a frame that only exists as a bitmap; the caller keeps [bitmap] */
+    suspend fun encodeIfChanged(bitmap: Bitmap, maxVisualTokens: Int = 0): ImageEmbedding? {
+        require(nativePtr != 0L) { "Model not loaded" }
+        val (frame, width, height) = copyScaled(bitmap)
+        try {
+            return gate(frame, width, height, maxVisualTokens)
+        } finally {
+            framePool.release(frame)
+        }
+    }
+
+    private suspend fun gate(pixels: ByteBuffer, width: Int, height: Int, maxVisualTokens: Int): ImageEmbedding? {
+        val handle = cancellableHandle { request -> gateFrame(nativePtr, request, pixels, width, height, maxVisualTokens) }
+        return if (handle != 0L) ImageEmbedding(handle) else null
+    }
+
+    /**
+     * Start a two-stage continuous pipeline: frames given to [submit] are encoded, merged to
+     * [maxVisualTokens] and change-gated on a native worker thread, while the caller describes
+     * the previous one from [nextEncoded]. With a [latencyBudgetMs], each frame is scheduled to
+     * be described within that time of its capture: stale frames are dropped for fresher ones
+     * and late ones run with fewer visual tokens. Nothing else may encode images until released.
+     */
+    fun startPipeline(maxVisualTokens: Int = 0, latencyBudgetMs: Int = 0): ContinuousPipeline {
+        require(nativePtr != 0L) { "Model not loaded" }
+        return ContinuousPipeline(continuousStart(nativePtr, maxVisualTokens, latencyBudgetMs))
+    }
+
+    /**
+     * Offer [frame], releasing it, as frame [id] captured at [capturedNs] ([System.nanoTime]).
+     * Never waits on inference: it replaces any frame the encoder has not started yet. Returns
+     * the oldest id still in the pipeline, as no frame below it will come out of [nextEncoded],
+     * or 0 if the pipeline has stopped.
+     */
+    suspend fun submit(
+        pipeline: ContinuousPipeline, frame: CameraFrame, id: Long, capturedNs: Long = System.nanoTime()
+    ): Long = withContext(Dispatchers.IO) {
+        val pixels = requireNotNull(frame.pixels) { "Frame already released" }
+        try {
+            continuousSubmit(pipeline.handle, pixels, frame.bitmap.width, frame.bitmap.height, id, capturedNs)
+        } finally {
+            release(frame)
+        }
+    }
+
+    /** [submit] for a frame that only exists as a bitmap; the caller keeps [bitmap] */
+    suspend fun submit(
+        pipeline: ContinuousPipeline, bitmap: Bitmap, id: Long, capturedNs: Long = System.nanoTime()
+    ): Long = withContext(Dispatchers.IO) {
+        val scaled = scaleBitmap(bitmap, frameMaxDim)
+        val frame = framePool.copyOf(scaled)
+        val width = scaled.width
+        val height = scaled.height
         if (scaled !== bitmap) scaled.recycle()
-        result
+        try {
+            continuousSubmit(pipeline.handle, frame, width, height, id, capturedNs)
+        } finally {
+            framePool.release(frame)
+        }
+    }
+
+    /**
+     * Next frame out of the encoder stage; ids skip frames dropped as stale or replaced before
+     * encoding. Call [complete] once a returned embedding has been described.
+     */
+    suspend fun nextEncoded(pipeline: ContinuousPipeline): PipelineFrame {
+        val info = LongArray(1)
+        val handle = cancellableHandle { request -> continuousNext(pipeline.handle, request, info) }
+        return PipelineFrame(info[0], if (handle != 0L) ImageEmbedding(handle) else null)
+    }
+
+    /**
+     * The caller is done with the last embedding from [nextEncoded], its description shown at
+     * [describedNs]; call when ready for the next one, so the schedule counts the whole stage
+     */
+    fun complete(pipeline: ContinuousPipeline, describedNs: Long = System.nanoTime()) {
+        if (pipeline.handle != 0L) continuousComplete(pipeline.handle, describedNs)
+    }
+
+    fun pipelineStats(pipeline: ContinuousPipeline): PipelineStats {
+        val stats = continuousStats(pipeline.handle)
+        return PipelineStats(
+            stats[0], stats[1], stats[2],
+            stats[3].toInt(), stats[4].toInt(), stats[5].toInt()
+        )
+    }
+
+    /** Stop the pipeline's worker; calls still waiting on it must have returned */
+    fun release(pipeline: ContinuousPipeline) {
+        if (pipeline.handle != 0L) {
+            continuousStop(pipeline.handle)
+            pipeline.handle = 0L
+        }
+    }
+
+    /** Forget the change gate's reference frame and zero its counters */
+    fun resetChangeGate() {
+        if (nativePtr != 0L) changeGateReset(nativePtr)
+    }
+
+    fun changeGateStats(): ChangeGateStats {
+        if (nativePtr == 0L) return ChangeGateStats(0, 0, 0f)
+        val stats = readChangeGateStats(nativePtr)
+        return ChangeGateStats(stats[0].toInt(), stats[1].toInt(), stats[2])
+    }
+
+    /** Perceptual hash (64-bit dHash) of an ARGB_8888 bitmap; compare two with [hashDistance] */
+    fun frameHash(bitmap: Bitmap): Long = perceptualHash(bitmap)
+
+    /** Single frame inference on a [convertFrame]/[decodeFrame] result; the caller keeps the bitmap */
+    suspend fun describeFrame(
+        frame: CameraFrame,
+        prompt: String = IMAGE_PROMPT,
+        maxVisualTokens: Int = 0
+    ): String = withContext(Dispatchers.IO) {
+        require(nativePtr != 0L) { "Model not loaded" }
+        val pixels = requireNotNull(frame.pixels) { "Frame already released" }
+        try {
+            cancellable { request ->
+                runInference(
+                    nativePtr, request, pixels, frame.bitmap.width, frame.bitmap.height, prompt, maxVisualTokens
+                )
+            }
+        } finally {
+            release(frame)
+        }
     }
 
     /** Video inference: extract frames from video URI */
     suspend fun describeVideo(
         videoUri: Uri,
         retriever: MediaMetadataRetriever,
-        prompt: String = "What is the main action or notable event happening in this segment? Describe it in one brief sentence."
+        prompt: String = VIDEO_PROMPT,
+        maxVisualTokens: Int = 0
     ): String = withContext(Dispatchers.IO) {
         require(nativePtr != 0L) { "Model not loaded" }
 
-        val rawFrames = extractFrames(retriever)
+        val rawFrames = extractFrames(retriever, maxVisualTokens)
         if (rawFrames.isEmpty()) {
             throw IllegalStateException("Could not extract frames from video")
         }
 
         Log.i(TAG, "Extracted ${rawFrames.size} frames from video")
 
-        // Scale frames once, extract RGB, then recycle
-        val scaledFrames = rawFrames.map { scaleBitmap(it, FRAME_MAX_DIM) }
+        // Scale frames once, copy their pixels out, then recycle
+        val scaledFrames = rawFrames.map { scaleBitmap(it, frameMaxDim) }
         val widths = IntArray(scaledFrames.size) { scaledFrames[it].width }
         val heights = IntArray(scaledFrames.size) { scaledFrames[it].height }
-        val rgbArrays = Array(scaledFrames.size) { bitmapToRgb(scaledFrames[it]) }
+        val frames = Array(scaledFrames.size) { framePool.copyOf(scaledFrames[it]) }
 
         // Recycle all bitmaps
         scaledFrames.forEach { scaled ->
@@ -91,86 +396,491 @@ class LlamaModel {
         }
         rawFrames.forEach { it.recycle() }
 
-        runVideoInference(nativePtr, rgbArrays, widths, heights, prompt)
+        try {
+            cancellable { request -> runVideoInference(nativePtr, request, frames, widths, heights, prompt, maxVisualTokens) }
+        } finally {
+            frames.forEach { framePool.release(it) }
+        }
     }
 
     /** Single image inference — streaming, emits each token as it's generated */
     fun describeImageStreaming(
         bitmap: Bitmap,
-        prompt: String = "Describe this image."
-    ): Flow<String> = callbackFlow {
-        val scaled = scaleBitmap(bitmap, FRAME_MAX_DIM)
-        val rgbBytes = bitmapToRgb(scaled)
-
-        val callback = object : TokenCallback {
-            override fun onToken(token: String) {
-                trySend(token)
-            }
-            override fun onComplete(fullText: String) {
-                close()
-            }
-            override fun onError(error: String) {
-                close(IllegalStateException(error))
-            }
-        }
+        prompt: String = IMAGE_PROMPT,
+        maxVisualTokens: Int = 0
+    ): Flow<String> {
+        val scaled = scaleBitmap(bitmap, frameMaxDim)
+        val frame = framePool.copyOf(scaled)
+        val width = scaled.width
+        val height = scaled.height
+        if (scaled !== bitmap) scaled.recycle()
 
-        // Run native inference on IO thread — it blocks and calls callback per token
-        val job = kotlinx.coroutines.CoroutineScope(Dispatchers.IO).launch {
+        return nativeStreaming { request, callback ->
             try {
-                runInferenceStreaming(nativePtr, rgbBytes, scaled.width, scaled.height, prompt, callback)
-            } catch (e: Exception) {
-                close(e)
+                runInferenceStreaming(nativePtr, request, frame, width, height, prompt, maxVisualTokens, callback)
             } finally {
-                if (scaled !== bitmap) scaled.recycle()
+                framePool.release(frame)
             }
         }
-
-        awaitClose { job.cancel() }
     }
 
     /** Video inference — streaming, emits each token as it's generated */
     fun describeVideoStreaming(
         videoUri: Uri,
         retriever: MediaMetadataRetriever,
-        prompt: String = "What is the main action or notable event happening in this segment? Describe it in one brief sentence."
-    ): Flow<String> = callbackFlow {
-        val rawFrames = extractFrames(retriever)
+        prompt: String = VIDEO_PROMPT,
+        maxVisualTokens: Int = 0
+    ): Flow<String> {
+        val rawFrames = extractFrames(retriever, maxVisualTokens)
         if (rawFrames.isEmpty()) {
-            close(IllegalStateException("Could not extract frames from video"))
-            return@callbackFlow
+            return flow { throw IllegalStateException("Could not extract frames from video") }
         }
 
-        val scaledFrames = rawFrames.map { scaleBitmap(it, FRAME_MAX_DIM) }
+        val scaledFrames = rawFrames.map { scaleBitmap(it, frameMaxDim) }
         val widths = IntArray(scaledFrames.size) { scaledFrames[it].width }
         val heights = IntArray(scaledFrames.size) { scaledFrames[it].height }
-        val rgbArrays = Array(scaledFrames.size) { bitmapToRgb(scaledFrames[it]) }
+        val frames = Array(scaledFrames.size) { framePool.copyOf(scaledFrames[it]) }
 
         scaledFrames.forEach { scaled ->
             if (scaled !in rawFrames) scaled.recycle()
         }
         rawFrames.forEach { it.recycle() }
 
+        return nativeStreaming { request, callback ->
+            try {
+                runVideoInferenceStreaming(nativePtr, request, frames, widths, heights, prompt, maxVisualTokens, callback)
+            } finally {
+                frames.forEach { framePool.release(it) }
+            }
+        }
+    }
+
+    /**
+     * Long-video mode for clips of any length: every [segmentMs] of the clip is captioned from
+     * [framesPerSegment] frames with the KV cache starting over, captions are folded [group] at
+     * a time into summaries, and a final summary of what is left is streamed. Memory stays
+     * bounded and the cost per second of video constant. [onSegment] gets each caption with
+     * the segment's index and the segment count.
+     */
+    fun describeLongVideoStreaming(
+        retriever: MediaMetadataRetriever,
+        segmentMs: Long = LONG_VIDEO_SEGMENT_MS,
+        framesPerSegment: Int = LONG_VIDEO_SEGMENT_FRAMES,
+        group: Int = LONG_VIDEO_GROUP,
+        maxVisualTokens: Int = 0,
+        onSegment: suspend (index: Int, count: Int, caption: String) -> Unit = { _, _, _ -> }
+    ): Flow<String> = flow {
+        require(nativePtr != 0L) { "Model not loaded" }
+        val durationMs = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_DURATION)?.toLongOrNull()
+            ?: throw IllegalStateException("Could not read the video duration")
+        val count = ((durationMs + segmentMs - 1) / segmentMs).toInt().coerceAtLeast(1)
+
+        val session = longVideoStart(nativePtr, group, SUMMARY_PROMPT)
+        // Whoever claims the session frees it: the summary call once it returns, since it may
+        // outlive a cancelled collector, or this flow when that call never got to start
+        val claimed = AtomicBoolean(false)
+        try {
+            for (i in 0 until count) {
+                val startMs = i * segmentMs
+                val endMs = minOf(durationMs, startMs + segmentMs)
+                val caption = describeSegment(session, retriever, startMs, endMs, framesPerSegment, maxVisualTokens)
+                Log.i(TAG, "Segment ${i + 1}/$count at ${startMs}ms: $caption")
+                onSegment(i, count, caption)
+            }
+            emitAll(nativeStreaming { request, callback ->
+                if (claimed.compareAndSet(false, true)) {
+                    try {
+                        longVideoSummarize(session, request, callback)
+                    } finally {
+                        longVideoFree(session)
+                    }
+                }
+            })
+        } finally {
+            if (claimed.compareAndSet(false, true)) longVideoFree(session)
+        }
+    }
+
+    /** Caption [startMs, endMs) from [frameCount] evenly spaced frames */
+    private suspend fun describeSegment(
+        session: Long, retriever: MediaMetadataRetriever,
+        startMs: Long, endMs: Long, frameCount: Int, maxVisualTokens: Int
+    ): String {
+        val (frames, widths, heights) = withContext(Dispatchers.IO) {
+            val step = (endMs - startMs) / frameCount
+            val bitmaps = (0 until frameCount).mapNotNull { i ->
+                retriever.getScaledFrameAtTime(
+                    (startMs + i * step + step / 2) * 1000, MediaMetadataRetriever.OPTION_CLOSEST,
+                    frameMaxDim, frameMaxDim
+                )
+            }
+            if (bitmaps.isEmpty()) {
+                throw IllegalStateException("Could not extract frames at ${startMs}ms")
+            }
+            val widths = IntArray(bitmaps.size) { bitmaps[it].width }
+            val heights = IntArray(bitmaps.size) { bitmaps[it].height }
+            val frames = Array(bitmaps.size) { framePool.copyOf(bitmaps[it]) }
+            bitmaps.forEach { it.recycle() }
+            Triple(frames, widths, heights)
+        }
+
+        try {
+            return cancellable { request ->
+                longVideoAddSegment(
+                    session, request, frames, widths, heights, startMs, endMs, SEGMENT_PROMPT, maxVisualTokens
+                )
+            }
+        } finally {
+            frames.forEach { framePool.release(it) }
+        }
+    }
+
+    /** Run the vision encoder once; the embedding can then be described and queried repeatedly */
+    suspend fun encode(bitmap: Bitmap): ImageEmbedding {
+        require(nativePtr != 0L) { "Model not loaded" }
+        val (frame, width, height) = copyScaled(bitmap)
+        try {
+            return ImageEmbedding(cancellableHandle { request -> encodeImage(nativePtr, request, frame, width, height) })
+        } finally {
+            framePool.release(frame)
+        }
+    }
+
+    /**
+     * Encode only [region] of [bitmap], cut from the pixels as given rather than from the
+     * downscaled global view, so a small detail fills the encoder input. Pass the result to
+     * [askStreaming] to ask about it on top of a chat that already holds the whole image.
+     */
+    suspend fun encodeRegion(bitmap: Bitmap, region: Rect): ImageEmbedding = withContext(Dispatchers.IO) {
+        val bounds = Rect(region)
+        require(bounds.intersect(0, 0, bitmap.width, bitmap.height)) { "Region is outside the image" }
+        val crop = Bitmap.createBitmap(bitmap, bounds.left, bounds.top, bounds.width(), bounds.height())
+        try {
+            encode(crop)
+        } finally {
+            if (crop !== bitmap) crop.recycle()
+        }
+    }
+
+    /** Extract and encode video frames, one embedding per frame */
+    suspend fun encodeVideo(retriever: MediaMetadataRetriever): List<ImageEmbedding> = withContext(Dispatchers.IO) {
+        require(nativePtr != 0L) { "Model not loaded" }
+
+        val rawFrames = extractFrames(retriever)
+        if (rawFrames.isEmpty()) {
+            throw IllegalStateException("Could not extract frames from video")
+        }
+
+        val embeddings = mutableListOf<ImageEmbedding>()
+        try {
+            for (frame in rawFrames) {
+                embeddings.add(encode(frame))
+            }
+        } catch (e: Exception) {
+            embeddings.forEach { release(it) }
+            throw e
+        } finally {
+            rawFrames.forEach { it.recycle() }
+        }
+        embeddings
+    }
+
+    /** Streaming inference over encoded images — goes straight to LLM prefill */
+    fun describeEmbeddingsStreaming(
+        embeddings: List<ImageEmbedding>,
+        prompt: String
+    ): Flow<String> {
+        val handles = LongArray(embeddings.size) { embeddings[it].handle }
+        return nativeStreaming { request, callback ->
+            runEmbeddingInferenceStreaming(nativePtr, request, handles, prompt, callback)
+        }
+    }
+
+    /** Reserve a native chat session, or null when every KV sequence is already in use */
+    fun createChat(): ChatSession? {
+        require(nativePtr != 0L) { "Model not loaded" }
+        val handle = createChatSession(nativePtr)
+        return if (handle != 0L) ChatSession(handle) else null
+    }
+
+    /** First chat turn: prefill the encoded images + prompt and stream the reply */
+    fun startChatStreaming(
+        session: ChatSession,
+        embeddings: List<ImageEmbedding>,
+        prompt: String
+    ): Flow<String> {
+        val handles = LongArray(embeddings.size) { embeddings[it].handle }
+        return nativeStreaming { request, callback ->
+            chatSessionStart(session.handle, request, handles, prompt, callback)
+        }
+    }
+
+    /**
+     * First chat turn over a video that is still recording: [prompt] is prefilled now, each
+     * [appendFrame] encodes and prefills a frame as it is captured, and [finishFramesStreaming]
+     * only has the end of the turn left to prefill before replying
+     */
+    suspend fun beginFrames(session: ChatSession, prompt: String = VIDEO_PROMPT) {
+        cancellable { request -> chatSessionBeginFrames(session.handle, request, prompt) }
+    }
+
+    /**
+     * Append [frame], [timestampMs] into the recording, to [session]'s turn, releasing it.
+     * The returned embedding is the caller's, e.g. for Q&A once the session is gone.
+     */
+    suspend fun appendFrame(
+        session: ChatSession, frame: CameraFrame, timestampMs: Long, maxVisualTokens: Int = 0
+    ): ImageEmbedding {
+        val pixels = requireNotNull(frame.pixels) { "Frame already released" }
+        try {
+            return ImageEmbedding(cancellableHandle { request ->
+                chatSessionAppendFrame(
+                    session.handle, request, pixels, frame.bitmap.width, frame.bitmap.height,
+                    timestampMs, maxVisualTokens
+                )
+            })
+        } finally {
+            release(frame)
+        }
+    }
+
+    /** Close the turn [appendFrame] built and stream the reply; [session] then takes follow-ups */
+    fun finishFramesStreaming(session: ChatSession): Flow<String> =
+        nativeStreaming { request, callback ->
+            chatSessionFinishFrames(session.handle, request, callback)
+        }
+
+    /**
+     * Follow-up turn: only the question tokens are prefilled, the rest stays in the KV cache.
+     * [embeddings] (e.g. from [encodeRegion]) are prefilled with the question.
+     */
+    fun askStreaming(
+        session: ChatSession,
+        question: String,
+        embeddings: List<ImageEmbedding> = emptyList()
+    ): Flow<String> {
+        val handles = LongArray(embeddings.size) { embeddings[it].handle }
+        return nativeStreaming { request, callback ->
+            chatSessionAsk(session.handle, request, handles, question, callback)
+        }
+    }
+
+    /**
+     * Keep only the last [maxTurns] turns of [session] in its KV cache (0 = all), evicting older
+     * ones after each follow-up, and cap each reply at [maxReplyTokens] (0 = the default)
+     */
+    fun limitChat(session: ChatSession, maxTurns: Int, maxReplyTokens: Int = 0) {
+        chatSessionSetLimits(session.handle, maxTurns, maxReplyTokens)
+    }
+
+    /** Content key of a bitmap as [encode] sees it; names the saved chat of that image */
+    suspend fun imageKey(bitmap: Bitmap): Long = withContext(Dispatchers.IO) {
+        val scaled = scaleBitmap(bitmap, frameMaxDim)
+        val frame = framePool.copyOf(scaled)
+        val key = hashImage(frame, scaled.width, scaled.height)
+        framePool.release(frame)
+        if (scaled !== bitmap) scaled.recycle()
+        key
+    }
+
+    /** Write a started chat (KV cache, sampler inputs, messages) to [file] */
+    suspend fun saveChat(session: ChatSession, file: File): Boolean = withContext(Dispatchers.IO) {
+        chatSessionSave(session.handle, file.absolutePath)
+    }
+
+    /** Resume the chat saved for the image with [key]; null if there is none or no session is free */
+    suspend fun restoreChat(file: File, key: Long): ChatSession? = withContext(Dispatchers.IO) {
+        if (!file.exists()) return@withContext null
+        val session = createChat() ?: return@withContext null
+        if (chatSessionRestore(session.handle, file.absolutePath, key)) {
+            session
+        } else {
+            release(session)
+            null
+        }
+    }
+
+    /** Messages of a chat as (role, content), starting with the first user turn */
+    fun history(session: ChatSession): List<Pair<String, String>> =
+        chatSessionHistory(session.handle).toList().chunked(2) { it[0] to it[1] }
+
+    fun release(session: ChatSession) {
+        if (session.handle != 0L) {
+            freeChatSession(session.handle)
+            session.handle = 0L
+        }
+    }
+
+    /**
+     * Native cancellation flag for one blocking call; safe to cancel before, during or after it.
+     * With a ring capacity, generated tokens reach Kotlin through a native byte ring instead of
+     * a JNI callback per token, so slow collectors never stall the decode thread.
+     */
+    private inner class NativeRequest(ringCapacity: Int = 0) : AutoCloseable {
+        var ptr = createRequest()
+            private set
+        private val ring: ByteBuffer? = if (ringCapacity > 0) attachTokenRing(ptr, ringCapacity) else null
+
+        @Synchronized
+        fun cancel() {
+            if (ptr != 0L) cancelRequest(ptr)
+        }
+
+        @Synchronized
+        fun closeTokens() {
+            if (ptr != 0L && ring != null) tokenRingClose(ptr)
+        }
+
+        @Synchronized
+        override fun close() {
+            if (ptr != 0L) {
+                requestVisualTokens(ptr).takeIf { it > 0 }?.let { lastVisualTokens = it }
+                freeRequest(ptr)
+                ptr = 0L
+            }
+        }
+
+        /** Read the ring until the native side closes it, emitting only whole UTF-8 characters */
+        fun drainTokens(emit: (String) -> Unit) {
+            val ring = ring ?: return
+            val capacity = ring.capacity()
+            var readCount = 0L
+            var pending = ByteArray(0)
+
+            while (true) {
+                val n = tokenRingWait(ptr, TOKEN_RING_WAIT_MS)
+                if (n < 0) break
+                if (n == 0) continue
+
+                val bytes = pending.copyOf(pending.size + n)
+                val start = (readCount % capacity).toInt()
+                val first = minOf(n, capacity - start)
+                ring.position(start)
+                ring.get(bytes, pending.size, first)
+                ring.position(0)
+                ring.get(bytes, pending.size + first, n - first)
+                readCount += n
+                tokenRingConsume(ptr, n)
+
+                val complete = utf8CompleteLength(bytes)
+                if (complete > 0) emit(String(bytes, 0, complete, Charsets.UTF_8))
+                pending = bytes.copyOfRange(complete, bytes.size)
+            }
+        }
+    }
+
+    /** Length of the prefix of [bytes] that does not end in a split multi-byte character */
+    private fun utf8CompleteLength(bytes: ByteArray): Int {
+        var lead = bytes.size - 1
+        while (lead >= 0 && bytes.size - lead < 4 && (bytes[lead].toInt() and 0xC0) == 0x80) lead--
+        if (lead < 0) return bytes.size
+        val b = bytes[lead].toInt() and 0xFF
+        val len = when {
+            b >= 0xF0 -> 4
+            b >= 0xE0 -> 3
+            b >= 0xC0 -> 2
+            else -> 1
+        }
+        return if (bytes.size - lead >= len) bytes.size else lead
+    }
+
+    /**
+     * [bitmap] scaled to the encoder input in a pooled buffer, with its size. Callers that get a
+     * handle back run [cancellableHandle] outside of this, as returning through another
+     * [withContext] could drop the handle on cancellation.
+     */
+    private suspend fun copyScaled(bitmap: Bitmap): Triple<ByteBuffer, Int, Int> = withContext(Dispatchers.IO) {
+        val scaled = scaleBitmap(bitmap, frameMaxDim)
+        val frame = framePool.copyOf(scaled)
+        val width = scaled.width
+        val height = scaled.height
+        if (scaled !== bitmap) scaled.recycle()
+        Triple(frame, width, height)
+    }
+
+    /**
+     * [cancellable] for a call returning an embedding handle, freed when it is delivered just as
+     * the caller gives up on it instead of leaking with nobody to release it
+     */
+    private suspend fun cancellableHandle(run: (Long) -> Long): Long {
+        var handle = 0L
+        try {
+            return cancellable { request -> run(request).also { handle = it } }
+        } catch (e: CancellationException) {
+            if (handle != 0L) freeImageEmbedding(handle)
+            throw e
+        }
+    }
+
+    /** Run a blocking native call on IO; cancelling the caller aborts it within one decode step */
+    private suspend fun <T> cancellable(run: (Long) -> T): T = coroutineScope {
+        val request = NativeRequest()
+        val watcher = launch(start = CoroutineStart.UNDISPATCHED) {
+            try {
+                awaitCancellation()
+            } finally {
+                request.cancel()
+            }
+        }
+        try {
+            withContext(Dispatchers.IO) { run(request.ptr) }
+        } finally {
+            watcher.cancel()
+            request.close()
+        }
+    }
+
+    /**
+     * Run a blocking native streaming call on IO and expose its tokens as a Flow.
+     * Closing the flow cancels the native request instead of letting it run to MAX_TOKENS.
+     */
+    private fun nativeStreaming(run: (Long, TokenCallback) -> Unit): Flow<String> = callbackFlow {
+        val request = NativeRequest(TOKEN_RING_BYTES)
+        var failure: Throwable? = null
         val callback = object : TokenCallback {
             override fun onToken(token: String) {
-                trySend(token)
-            }
-            override fun onComplete(fullText: String) {
-                close()
+                trySendBlocking(token)
             }
+            override fun onComplete(fullText: String) {}
             override fun onError(error: String) {
-                close(IllegalStateException(error))
+                failure = IllegalStateException(error)
             }
         }
 
         val job = kotlinx.coroutines.CoroutineScope(Dispatchers.IO).launch {
-            try {
-                runVideoInferenceStreaming(nativePtr, rgbArrays, widths, heights, prompt, callback)
-            } catch (e: Exception) {
-                close(e)
+            val producer = launch {
+                try {
+                    run(request.ptr, callback)
+                } catch (e: Exception) {
+                    failure = e
+                }
             }
+            producer.invokeOnCompletion { request.closeTokens() }
+
+            // Only this thread waits on the collector; the generator just writes to the ring
+            request.drainTokens { trySendBlocking(it) }
+            producer.join()
+            close(failure)
+        }
+        job.invokeOnCompletion { request.close() }
+
+        awaitClose {
+            request.cancel()
+            job.cancel()
+        }
+    }
+
+    fun release(embedding: ImageEmbedding) {
+        if (embedding.handle != 0L) {
+            freeImageEmbedding(embedding.handle)
+            embedding.handle = 0L
         }
+    }
 
-        awaitClose { job.cancel() }
+    /** Return a frame's pixels to the pool; its bitmap stays valid */
+    fun release(frame: CameraFrame) {
+        frame.pixels?.let { framePool.release(it) }
+        frame.pixels = null
     }
 
     fun free() {
@@ -180,24 +890,48 @@ class LlamaModel {
         }
     }
 
-    /** Extract evenly-spaced frames from video */
-    private fun extractFrames(retriever: MediaMetadataRetriever): List<Bitmap> {
+    /**
+     * Decode [VIDEO_CANDIDATE_FRAMES] evenly spaced frames at encoder scale and keep the
+     * keyframes native code picks among them by appearance change: at most [VIDEO_NUM_FRAMES],
+     * fewer when [maxVisualTokens] could not give each one [MIN_FRAME_VISUAL_TOKENS], and fewer
+     * still when the clip has fewer distinct moments.
+     */
+    private fun extractFrames(retriever: MediaMetadataRetriever, maxVisualTokens: Int = 0): List<Bitmap> {
         val durationStr = retriever.extractMetadata(MediaMetadataRetriever.METADATA_KEY_DURATION)
         val durationMs = durationStr?.toLongOrNull() ?: VIDEO_DURATION_MS
         val actualDuration = minOf(durationMs, VIDEO_DURATION_MS)
 
-        val frames = mutableListOf<Bitmap>()
-        val interval = actualDuration / VIDEO_NUM_FRAMES
+        val candidates = mutableListOf<Bitmap>()
+        val interval = actualDuration / VIDEO_CANDIDATE_FRAMES
 
-        for (i in 0 until VIDEO_NUM_FRAMES) {
+        for (i in 0 until VIDEO_CANDIDATE_FRAMES) {
             val timeUs = (i * interval * 1000) // microseconds
-            val frame = retriever.getFrameAtTime(timeUs, MediaMetadataRetriever.OPTION_CLOSEST)
+            val frame = retriever.getScaledFrameAtTime(
+                timeUs, MediaMetadataRetriever.OPTION_CLOSEST, frameMaxDim, frameMaxDim
+            )
             if (frame != null) {
-                frames.add(frame)
-                Log.i(TAG, "Frame $i at ${i * interval}ms: ${frame.width}x${frame.height}")
+                // Native selection reads pixels as RGBA_8888
+                candidates.add(if (frame.config == Bitmap.Config.ARGB_8888) frame else {
+                    frame.copy(Bitmap.Config.ARGB_8888, false).also { frame.recycle() }
+                })
             }
         }
+        if (candidates.isEmpty()) return candidates
 
+        val maxFrames = if (maxVisualTokens > 0) {
+            (maxVisualTokens / MIN_FRAME_VISUAL_TOKENS).coerceIn(1, VIDEO_NUM_FRAMES)
+        } else VIDEO_NUM_FRAMES
+        val picked = selectKeyframes(candidates.toTypedArray(), maxFrames).toSet()
+
+        val frames = mutableListOf<Bitmap>()
+        candidates.forEachIndexed { i, frame ->
+            if (i in picked) {
+                frames.add(frame)
+                Log.i(TAG, "Keyframe $i at ${i * interval}ms: ${frame.width}x${frame.height}")
+            } else {
+                frame.recycle()
+            }
+        }
         return frames
     }
 
@@ -212,33 +946,6 @@ class LlamaModel {
         return Bitmap.createScaledBitmap(bitmap, newW, newH, true)
     }
 
-    private fun bitmapToRgb(bitmap: Bitmap): ByteArray {
-        val argbBitmap = if (bitmap.config != Bitmap.Config.ARGB_8888) {
-            bitmap.copy(Bitmap.Config.ARGB_8888, false)
-        } else {
-            bitmap
-        }
-
-        val width = argbBitmap.width
-        val height = argbBitmap.height
-        val pixels = IntArray(width * height)
-        argbBitmap.getPixels(pixels, 0, width, 0, 0, width, height)
-
-        val rgb = ByteArray(width * height * 3)
-        for (i in pixels.indices) {
-            val pixel = pixels[i]
-            rgb[i * 3]     = ((pixel shr 16) and 0xFF).toByte()
-            rgb[i * 3 + 1] = ((pixel shr 8) and 0xFF).toByte()
-            rgb[i * 3 + 2] = (pixel and 0xFF).toByte()
-        }
-
-        if (argbBitmap !== bitmap) {
-            argbBitmap.recycle()
-        }
-
-        return rgb
-    }
-
     // Native methods
     private external fun loadModel(
         modelPath: String, mmprojPath: String,
@@ -246,26 +953,143 @@ class LlamaModel {
     ): Long
 
     private external fun runInference(
-        ctxPtr: Long, imageBytes: ByteArray,
-        width: Int, height: Int, prompt: String
+        ctxPtr: Long, requestPtr: Long, frame: ByteBuffer,
+        width: Int, height: Int, prompt: String, maxVisualTokens: Int
     ): String
 
     private external fun runVideoInference(
-        ctxPtr: Long, frames: Array<ByteArray>,
-        widths: IntArray, heights: IntArray, prompt: String
+        ctxPtr: Long, requestPtr: Long, frames: Array<ByteBuffer>,
+        widths: IntArray, heights: IntArray, prompt: String, maxVisualTokens: Int
     ): String
 
     private external fun runInferenceStreaming(
-        ctxPtr: Long, imageBytes: ByteArray,
-        width: Int, height: Int, prompt: String,
+        ctxPtr: Long, requestPtr: Long, frame: ByteBuffer,
+        width: Int, height: Int, prompt: String, maxVisualTokens: Int,
         callback: TokenCallback
     )
 
     private external fun runVideoInferenceStreaming(
-        ctxPtr: Long, frames: Array<ByteArray>,
-        widths: IntArray, heights: IntArray, prompt: String,
+        ctxPtr: Long, requestPtr: Long, frames: Array<ByteBuffer>,
+        widths: IntArray, heights: IntArray, prompt: String, maxVisualTokens: Int,
+        callback: TokenCallback
+    )
+
+    private external fun encodeImage(
+        ctxPtr: Long, requestPtr: Long, frame: ByteBuffer,
+        width: Int, height: Int
+    ): Long
+
+    private external fun gateFrame(
+        ctxPtr: Long, requestPtr: Long, frame: ByteBuffer,
+        width: Int, height: Int, maxVisualTokens: Int
+    ): Long
+
+    private external fun continuousStart(ctxPtr: Long, maxVisualTokens: Int, latencyBudgetMs: Int): Long
+
+    private external fun continuousSubmit(
+        pipelinePtr: Long, frame: ByteBuffer, width: Int, height: Int, frameId: Long, capturedNs: Long
+    ): Long
+
+    private external fun continuousNext(pipelinePtr: Long, requestPtr: Long, info: LongArray): Long
+
+    private external fun continuousComplete(pipelinePtr: Long, describedNs: Long)
+
+    private external fun continuousStats(pipelinePtr: Long): FloatArray
+
+    private external fun continuousStop(pipelinePtr: Long)
+
+    private external fun setChangeGateThreshold(ctxPtr: Long, threshold: Float)
+
+    private external fun changeGateReset(ctxPtr: Long)
+
+    private external fun readChangeGateStats(ctxPtr: Long): FloatArray
+
+    private external fun runEmbeddingInferenceStreaming(
+        ctxPtr: Long, requestPtr: Long, embeddings: LongArray, prompt: String,
+        callback: TokenCallback
+    )
+
+    private external fun freeImageEmbedding(embdPtr: Long)
+
+    private external fun createRequest(): Long
+
+    private external fun cancelRequest(requestPtr: Long)
+
+    private external fun freeRequest(requestPtr: Long)
+
+    private external fun attachTokenRing(requestPtr: Long, capacity: Int): ByteBuffer
+
+    private external fun tokenRingWait(requestPtr: Long, timeoutMs: Int): Int
+
+    private external fun tokenRingConsume(requestPtr: Long, nBytes: Int)
+
+    private external fun tokenRingClose(requestPtr: Long)
+
+    private external fun createChatSession(ctxPtr: Long): Long
+
+    private external fun chatSessionStart(
+        sessionPtr: Long, requestPtr: Long, embeddings: LongArray, prompt: String,
         callback: TokenCallback
     )
 
+    private external fun chatSessionAsk(
+        sessionPtr: Long, requestPtr: Long, embeddings: LongArray, question: String,
+        callback: TokenCallback
+    )
+
+    private external fun longVideoStart(ctxPtr: Long, group: Int, summaryPrompt: String): Long
+
+    private external fun longVideoAddSegment(
+        sessionPtr: Long, requestPtr: Long, frames: Array<ByteBuffer>, widths: IntArray, heights: IntArray,
+        startMs: Long, endMs: Long, prompt: String, maxVisualTokens: Int
+    ): String
+
+    private external fun longVideoSummarize(sessionPtr: Long, requestPtr: Long, callback: TokenCallback)
+
+    private external fun longVideoFree(sessionPtr: Long)
+
+    private external fun chatSessionBeginFrames(sessionPtr: Long, requestPtr: Long, prompt: String)
+
+    private external fun chatSessionAppendFrame(
+        sessionPtr: Long, requestPtr: Long, frame: ByteBuffer, width: Int, height: Int,
+        timestampMs: Long, maxVisualTokens: Int
+    ): Long
+
+    private external fun chatSessionFinishFrames(sessionPtr: Long, requestPtr: Long, callback: TokenCallback)
+
+    private external fun chatSessionSetLimits(sessionPtr: Long, maxTurns: Int, maxReplyTokens: Int)
+
+    private external fun freeChatSession(sessionPtr: Long)
+
+    private external fun chatSessionSave(sessionPtr: Long, path: String): Boolean
+
+    private external fun chatSessionRestore(sessionPtr: Long, path: String, imageHash: Long): Boolean
+
+    private external fun chatSessionHistory(sessionPtr: Long): Array<String>
+
+    private external fun selectKeyframes(frames: Array<Bitmap>, count: Int): IntArray
+
+    private external fun hashImage(frame: ByteBuffer, width: Int, height: Int): Long
+
+    private external fun encoderInputSize(ctxPtr: Long): Int
+
+    private external fun setVisualTokenKeepRatio(ctxPtr: Long, ratio: Float)
+
+    private external fun requestVisualTokens(requestPtr: Long): Int
+
+    private external fun decodeImage(
+        src: ByteBuffer, srcSize: Int, rotationDegrees: Int, maxDim: Int,
+        dst: ByteBuffer, dims: IntArray
+    ): Boolean
+
+    private external fun yuvToRgba(
+        yPlane: ByteBuffer, uPlane: ByteBuffer, vPlane: ByteBuffer,
+        yRowStride: Int, uvRowStride: Int, uvPixelStride: Int,
+        width: Int, height: Int, rotationDegrees: Int,
+        dst: ByteBuffer, dstWidth: Int, dstHeight: Int
+    ): Long
+
+    private external fun perceptualHash(bitmap: Bitmap): Long
+
     private external fun freeModel(ctxPtr: Long)
 }
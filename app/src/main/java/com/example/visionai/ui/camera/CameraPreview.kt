@@ -1,6 +1,7 @@
 package com.example.visionai.ui.camera
 
 import android.content.Context
+import androidx.camera.core.ImageAnalysis
 import androidx.camera.core.ImageCapture
 import androidx.camera.video.Recorder
 import androidx.camera.video.VideoCapture
@@ -15,7 +16,7 @@ import androidx.lifecycle.compose.LocalLifecycleOwner
 
 @Composable
 fun CameraPreview(
-    onBound: (ImageCapture, VideoCapture<Recorder>) -> Unit,
+    onBound: (ImageCapture, VideoCapture<Recorder>, ImageAnalysis?) -> Unit,
     modifier: Modifier = Modifier
 ) {
     val context: Context = LocalContext.current
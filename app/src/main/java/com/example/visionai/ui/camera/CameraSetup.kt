@@ -3,6 +3,7 @@ package com.example.visionai.ui.camera
 import android.content.Context
 import android.util.Log
 import androidx.camera.core.CameraSelector
+import androidx.camera.core.ImageAnalysis
 import androidx.camera.core.ImageCapture
 import androidx.camera.core.Preview
 import androidx.camera.lifecycle.ProcessCameraProvider
@@ -20,7 +21,7 @@ object CameraSetup {
         context: Context,
         lifecycleOwner: LifecycleOwner,
         previewView: PreviewView,
-        onBound: (ImageCapture, VideoCapture<Recorder>) -> Unit
+        onBound: (ImageCapture, VideoCapture<Recorder>, ImageAnalysis?) -> Unit
     ) {
         val cameraProviderFuture = ProcessCameraProvider.getInstance(context)
         cameraProviderFuture.addListener({
@@ -38,14 +39,34 @@ object CameraSetup {
                 .build()
             val videoCapture = VideoCapture.withOutput(recorder)
 
+            // YUV frames for continuous mode, converted natively without a JPEG round trip
+            val imageAnalysis = ImageAnalysis.Builder()
+                .setBackpressureStrategy(ImageAnalysis.STRATEGY_KEEP_ONLY_LATEST)
+                .setOutputImageFormat(ImageAnalysis.OUTPUT_IMAGE_FORMAT_YUV_420_888)
+                .build()
+
             try {
                 cameraProvider.unbindAll()
-                cameraProvider.bindToLifecycle(
-                    lifecycleOwner,
-                    CameraSelector.DEFAULT_BACK_CAMERA,
-                    preview, imageCapture, videoCapture
-                )
-                onBound(imageCapture, videoCapture)
+                val analysis = try {
+                    cameraProvider.bindToLifecycle(
+                        lifecycleOwner,
+                        CameraSelector.DEFAULT_BACK_CAMERA,
+                        preview, imageCapture, videoCapture, imageAnalysis
+                    )
+                    imageAnalysis
+                } catch (e: IllegalArgumentException) {
+                    // Not every device streams four use cases at once; continuous mode then
+                    // falls back to ImageCapture
+                    Log.w("VisionAI", "ImageAnalysis unsupported alongside capture, binding without it", e)
+                    cameraProvider.unbindAll()
+                    cameraProvider.bindToLifecycle(
+                        lifecycleOwner,
+                        CameraSelector.DEFAULT_BACK_CAMERA,
+                        preview, imageCapture, videoCapture
+                    )
+                    null
+                }
+                onBound(imageCapture, videoCapture, analysis)
             } catch (e: Exception) {
                 Log.e("VisionAI", "Camera bind failed", e)
             }
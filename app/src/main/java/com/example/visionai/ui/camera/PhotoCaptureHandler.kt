@@ -14,6 +14,7 @@ object PhotoCaptureHandler {
     fun capture(
         context: Context,
         imageCapture: ImageCapture?,
+        decode: (ImageProxy) -> Bitmap? = { null },
         onCaptured: (Bitmap) -> Unit
     ) {
         imageCapture ?: return
@@ -22,6 +23,13 @@ object PhotoCaptureHandler {
             ContextCompat.getMainExecutor(context),
             object : ImageCapture.OnImageCapturedCallback() {
                 override fun onCaptureSuccess(imageProxy: ImageProxy) {
+                    // Reduced-scale native decode first; full-size Bitmap + Matrix otherwise
+                    val decoded = decode(imageProxy)
+                    if (decoded != null) {
+                        imageProxy.close()
+                        onCaptured(decoded)
+                        return
+                    }
                     val bitmap = imageProxy.toBitmap()
                     val rotation = imageProxy.imageInfo.rotationDegrees
                     val rotated = if (rotation != 0) {
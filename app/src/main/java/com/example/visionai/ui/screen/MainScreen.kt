@@ -4,6 +4,7 @@ import android.Manifest
 import androidx.compose.animation.AnimatedVisibility
 import androidx.compose.animation.fadeIn
 import androidx.compose.animation.fadeOut
+import androidx.camera.core.ImageAnalysis
 import androidx.camera.core.ImageCapture
 import androidx.camera.video.Recorder
 import androidx.camera.video.Recording
@@ -74,6 +75,7 @@ fun MainScreen(viewModel: MainViewModel = viewModel()) {
 
     var imageCapture by remember { mutableStateOf<ImageCapture?>(null) }
     var videoCapture by remember { mutableStateOf<VideoCapture<Recorder>?>(null) }
+    var imageAnalysis by remember { mutableStateOf<ImageAnalysis?>(null) }
     var activeRecording by remember { mutableStateOf<Recording?>(null) }
 
     val isProcessing = state.inferenceState == InferenceState.RUNNING
@@ -91,8 +93,8 @@ fun MainScreen(viewModel: MainViewModel = viewModel()) {
     }
 
     // Register capture refs so ViewModel can trigger captures by voice
-    LaunchedEffect(imageCapture) {
-        viewModel.registerCaptureRefs(context, imageCapture)
+    LaunchedEffect(imageCapture, imageAnalysis) {
+        viewModel.registerCaptureRefs(context, imageCapture, imageAnalysis)
     }
 
     // Observe voiceTriggerAction to start/stop video recording from ViewModel
@@ -135,9 +137,10 @@ fun MainScreen(viewModel: MainViewModel = viewModel()) {
         // Layer 1: Camera preview
         if (cameraGranted) {
             CameraPreview(
-                onBound = { img, vid ->
+                onBound = { img, vid, analysis ->
                     imageCapture = img
                     videoCapture = vid
+                    imageAnalysis = analysis
                 }
             )
         }
@@ -174,7 +177,7 @@ fun MainScreen(viewModel: MainViewModel = viewModel()) {
                 onShutterClick = {
                     when (state.captureMode) {
                         CaptureMode.PHOTO -> {
-                            PhotoCaptureHandler.capture(context, imageCapture) { bitmap ->
+                            PhotoCaptureHandler.capture(context, imageCapture, viewModel::decodePhoto) { bitmap ->
                                 viewModel.onPhotoCapturedAndDescribe(bitmap)
                             }
                         }
@@ -206,7 +209,7 @@ fun MainScreen(viewModel: MainViewModel = viewModel()) {
                             if (isContinuousRunning) {
                                 viewModel.stopContinuous()
                             } else {
-                                viewModel.startContinuous(context, imageCapture)
+                                viewModel.startContinuous(context, imageCapture, imageAnalysis)
                             }
                         }
                     }
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+// Benchmarks run a few iterations as ctest smoke tests; pass --full for stable numbers
+static int bench_iterations(int argc, char ** argv, int full) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--full") == 0) {
+            return full;
+        }
+    }
+    return std::max(1, full / 50);
+}
+
+// Median wall time of `iterations` runs of `fn`, in microseconds
+template <typename F>
+static double bench_median_us(int iterations, F && fn) {
+    std::vector<double> us(iterations);
+    for (int i = 0; i < iterations; i++) {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn();
+        us[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    }
+    std::nth_element(us.begin(), us.begin() + iterations / 2, us.end());
+    return us[iterations / 2];
+}
+
+// Keep the optimizer from discarding a result nobody reads
+static void bench_keep(const void * p) {
+    asm volatile("" : : "g"(p) : "memory");
+}
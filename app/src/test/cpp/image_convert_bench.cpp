@@ -0,0 +1,52 @@
+// RGBA -> RGB conversion of one FRAME_MAX_DIM frame: the SIMD kernel against the per-pixel
+// unpacking LlamaModel.bitmapToRgb() did in Kotlin (getPixels into ARGB ints, three shifts and
+// masks per pixel). The Kotlin loop also paid for the getPixels copy and array bounds checks,
+// so on device the gap is larger than the host numbers show.
+
+#include "bench.h"
+#include "image_convert.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// The old path, one packed 0xAARRGGBB int per pixel
+static void argb_ints_to_rgb(uint8_t * dst, const int32_t * argb, size_t n_pixels) {
+    for (size_t i = 0; i < n_pixels; i++) {
+        const int32_t p = argb[i];
+        dst[i * 3 + 0] = (uint8_t) ((p >> 16) & 0xFF);
+        dst[i * 3 + 1] = (uint8_t) ((p >> 8) & 0xFF);
+        dst[i * 3 + 2] = (uint8_t) (p & 0xFF);
+    }
+}
+
+int main(int argc, char ** argv) {
+    const int iterations = bench_iterations(argc, argv, 500);
+
+    for (int dim : { 384, 512 }) {
+        const size_t n_pixels = (size_t) dim * dim;
+        std::mt19937 rng(dim);
+        std::vector<uint8_t> rgba(n_pixels * 4);
+        for (uint8_t & b : rgba) {
+            b = (uint8_t) rng();
+        }
+        // getPixels() copied the bitmap out as ints, which the Kotlin loop then unpacked
+        std::vector<int32_t> argb(n_pixels);
+        for (size_t i = 0; i < n_pixels; i++) {
+            argb[i] = (int32_t) (0xFF000000u | rgba[i * 4] << 16 | rgba[i * 4 + 1] << 8 | rgba[i * 4 + 2]);
+        }
+
+        std::vector<uint8_t> rgb(n_pixels * 3);
+        const double ints_us = bench_median_us(iterations, [&] {
+            argb_ints_to_rgb(rgb.data(), argb.data(), n_pixels);
+            bench_keep(rgb.data());
+        });
+        const double simd_us = bench_median_us(iterations, [&] {
+            rgba_to_rgb(rgb.data(), rgba.data(), n_pixels);
+            bench_keep(rgb.data());
+        });
+        printf("%dx%d  per-pixel ints: %8.1f us   rgba_to_rgb: %8.1f us   %.1fx\n",
+               dim, dim, ints_us, simd_us, ints_us / simd_us);
+    }
+    return 0;
+}
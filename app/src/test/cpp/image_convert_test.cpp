@@ -0,0 +1,390 @@
+// The SIMD RGBA -> RGB kernels (NEON on arm64, SSSE3 on x86) must match a plain scalar
+// conversion bit for bit, for every width around the 16-pixel block and in place. The camera
+// paths (YUV_420_888 to RGBA with rotation and resampling, RGBA rotation, EXIF orientation)
+// are checked against straightforward per-pixel references.
+
+#include "image_convert.h"
+
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);  \
+            fprintf(stderr, __VA_ARGS__);                  \
+            fprintf(stderr, "\n");                         \
+            failures++;                                    \
+        }                                                  \
+    } while (0)
+
+static std::vector<uint8_t> scalar_rgb(const std::vector<uint8_t> & rgba, size_t n_pixels) {
+    std::vector<uint8_t> rgb(n_pixels * 3);
+    for (size_t i = 0; i < n_pixels; i++) {
+        rgb[i * 3 + 0] = rgba[i * 4 + 0];
+        rgb[i * 3 + 1] = rgba[i * 4 + 1];
+        rgb[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+    return rgb;
+}
+
+static size_t first_difference(const uint8_t * a, const uint8_t * b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return i;
+        }
+    }
+    return n;
+}
+
+// Out of place, with a canary past the output that no path may touch
+static void check_out_of_place(std::mt19937 & rng, size_t n_pixels) {
+    std::vector<uint8_t> rgba(n_pixels * 4);
+    for (uint8_t & b : rgba) {
+        b = (uint8_t) rng();
+    }
+    const std::vector<uint8_t> expected = scalar_rgb(rgba, n_pixels);
+
+    std::vector<uint8_t> out(n_pixels * 3 + 16, 0xA5);
+    rgba_to_rgb(out.data(), rgba.data(), n_pixels);
+
+    const size_t at = first_difference(out.data(), expected.data(), n_pixels * 3);
+    CHECK(at == n_pixels * 3, "%zu pixels: byte %zu differs", n_pixels, at);
+    for (size_t i = n_pixels * 3; i < out.size(); i++) {
+        CHECK(out[i] == 0xA5, "%zu pixels: wrote past the end at byte %zu", n_pixels, i);
+    }
+}
+
+// dst == src, as rgb_from_buffer used to call it
+static void check_in_place(std::mt19937 & rng, size_t n_pixels) {
+    std::vector<uint8_t> buf(n_pixels * 4);
+    for (uint8_t & b : buf) {
+        b = (uint8_t) rng();
+    }
+    const std::vector<uint8_t> expected = scalar_rgb(buf, n_pixels);
+
+    rgba_to_rgb(buf.data(), buf.data(), n_pixels);
+    const size_t at = first_difference(buf.data(), expected.data(), n_pixels * 3);
+    CHECK(at == n_pixels * 3, "%zu pixels in place: byte %zu differs", n_pixels, at);
+}
+
+// Rows of odd widths converted one at a time from a padded source, like a strided bitmap
+static void check_rows(std::mt19937 & rng, int width, int height, int pad) {
+    const size_t stride = (size_t) width * 4 + pad;
+    std::vector<uint8_t> src(stride * height);
+    for (uint8_t & b : src) {
+        b = (uint8_t) rng();
+    }
+
+    std::vector<uint8_t> out((size_t) width * height * 3);
+    for (int y = 0; y < height; y++) {
+        rgba_to_rgb(out.data() + (size_t) y * width * 3, src.data() + y * stride, width);
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                const uint8_t got  = out[((size_t) y * width + x) * 3 + c];
+                const uint8_t want = src[y * stride + x * 4 + c];
+                if (got != want) {
+                    CHECK(false, "%dx%d row %d pixel %d channel %d", width, height, y, x, c);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+// Source pixel that lands at (x, y) of an image rotated clockwise by `rotation`, where the
+// source is `w` x `h`: the inverse of the mapping rotate_rgba documents
+static void unrotate(int x, int y, int w, int h, int rotation, int & sx, int & sy) {
+    switch (rotation) {
+        case 90:  sx = y;         sy = h - 1 - x; break;
+        case 180: sx = w - 1 - x; sy = h - 1 - y; break;
+        case 270: sx = w - 1 - y; sy = x;         break;
+        default:  sx = x;         sy = y;         break;
+    }
+}
+
+// A YUV_420_888 image in one buffer, laid out the way CameraX hands it over: planar chroma
+// (pixel stride 1) or interleaved VU (pixel stride 2), every row padded by `pad` bytes
+struct YuvImage {
+    std::vector<uint8_t> data;
+    YuvPlanes planes;
+};
+
+static YuvImage make_yuv(std::mt19937 & rng, int width, int height, int uv_pixel_stride, int pad) {
+    const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    const int y_stride  = width + pad;
+    const int uv_stride = (uv_pixel_stride == 2 ? cw * 2 : cw) + pad;
+    const size_t y_size  = (size_t) y_stride * height;
+    const size_t uv_size = (size_t) uv_stride * ch;
+
+    YuvImage img;
+    img.data.resize(y_size + 2 * uv_size + 1);
+    for (uint8_t & b : img.data) {
+        b = (uint8_t) rng();
+    }
+    const uint8_t * base = img.data.data();
+    if (uv_pixel_stride == 2) {
+        // NV21: one interleaved plane, V first, U one byte later
+        img.planes = { base, base + y_size + 1, base + y_size, y_stride, uv_stride, 2, width, height };
+    } else {
+        img.planes = { base, base + y_size, base + y_size + uv_size, y_stride, uv_stride, 1, width, height };
+    }
+    return img;
+}
+
+// Per-pixel reference: rotate, then nearest-neighbour sample at output pixel centres, then the
+// same 6-bit fixed-point BT.601 the kernels document
+static std::vector<uint8_t> reference_rgba(const YuvPlanes & p, int dst_w, int dst_h, int rotation) {
+    const bool transpose = rotation == 90 || rotation == 270;
+    const int rot_w = transpose ? p.height : p.width;
+    const int rot_h = transpose ? p.width  : p.height;
+    auto q6 = [](int v) {
+        v = (v + 32) >> 6;
+        return (uint8_t) std::min(255, std::max(0, v));
+    };
+
+    std::vector<uint8_t> out((size_t) dst_w * dst_h * 4);
+    for (int y = 0; y < dst_h; y++) {
+        for (int x = 0; x < dst_w; x++) {
+            const int rx = (int) ((2 * x + 1) * (int64_t) rot_w / (2 * dst_w));
+            const int ry = (int) ((2 * y + 1) * (int64_t) rot_h / (2 * dst_h));
+            int sx, sy;
+            unrotate(rx, ry, p.width, p.height, rotation, sx, sy);
+
+            const int yy = p.y[sy * p.y_row_stride + sx] << 6;
+            const size_t c = (size_t) (sy / 2) * p.uv_row_stride + (sx / 2) * p.uv_pixel_stride;
+            const int uu = p.u[c] - 128;
+            const int vv = p.v[c] - 128;
+            uint8_t * o = &out[((size_t) y * dst_w + x) * 4];
+            o[0] = q6(yy + 90 * vv);
+            o[1] = q6(yy - 22 * uu - 46 * vv);
+            o[2] = q6(yy + 113 * uu);
+            o[3] = 255;
+        }
+    }
+    return out;
+}
+
+static void check_yuv(std::mt19937 & rng, int width, int height, int uv_pixel_stride, int pad,
+                      int dst_w, int dst_h, int rotation) {
+    const YuvImage img = make_yuv(rng, width, height, uv_pixel_stride, pad);
+    const std::vector<uint8_t> expected = reference_rgba(img.planes, dst_w, dst_h, rotation);
+
+    const size_t n = (size_t) dst_w * dst_h * 4;
+    std::vector<uint8_t> out(n + 16, 0xA5);
+    yuv420_to_rgba(out.data(), dst_w, dst_h, img.planes, rotation);
+
+    const size_t at = first_difference(out.data(), expected.data(), n);
+    CHECK(at == n, "%dx%d ps%d pad %d -> %dx%d rot %d: byte %zu (pixel %zu, %zu) differs",
+          width, height, uv_pixel_stride, pad, dst_w, dst_h, rotation, at,
+          at / 4 % dst_w, at / 4 / dst_w);
+    for (size_t i = n; i < out.size(); i++) {
+        CHECK(out[i] == 0xA5, "%dx%d rot %d: wrote past the end at byte %zu", width, height, rotation, i);
+    }
+}
+
+// The fixed-point constants stay within rounding of the exact BT.601 full-range matrix
+static void check_yuv_colours() {
+    int worst = 0;
+    for (int y = 0; y < 256; y += 5) {
+        for (int u = 0; u < 256; u += 5) {
+            for (int v = 0; v < 256; v += 5) {
+                uint8_t yb[8], ub[8], vb[8], out[32];
+                std::fill(yb, yb + 8, (uint8_t) y);
+                std::fill(ub, ub + 8, (uint8_t) u);
+                std::fill(vb, vb + 8, (uint8_t) v);
+                // 8 pixels so the SIMD block runs; chroma shared by 2x2 luma
+                const YuvPlanes p = { yb, ub, vb, 8, 4, 1, 8, 1 };
+                yuv420_to_rgba(out, 8, 1, p, 0);
+
+                const double exact[3] = {
+                    y + 1.402 * (v - 128),
+                    y - 0.344136 * (u - 128) - 0.714136 * (v - 128),
+                    y + 1.772 * (u - 128),
+                };
+                for (int c = 0; c < 3; c++) {
+                    const int want = (int) std::lround(std::min(255.0, std::max(0.0, exact[c])));
+                    worst = std::max(worst, std::abs(out[c] - want));
+                }
+            }
+        }
+    }
+    CHECK(worst <= 2, "fixed-point colour off by %d from BT.601", worst);
+}
+
+static void check_rotate(std::mt19937 & rng, int width, int height, int pad_pixels, int rotation) {
+    const size_t stride = ((size_t) width + pad_pixels) * 4;
+    std::vector<uint8_t> src(stride * height);
+    for (uint8_t & b : src) {
+        b = (uint8_t) rng();
+    }
+    const bool transpose = rotation == 90 || rotation == 270;
+    const int dst_w = transpose ? height : width;
+    const int dst_h = transpose ? width  : height;
+
+    const size_t n = (size_t) width * height * 4;
+    std::vector<uint8_t> out(n + 16, 0xA5);
+    rotate_rgba(out.data(), src.data(), width, height, stride, rotation);
+
+    for (int y = 0; y < dst_h; y++) {
+        for (int x = 0; x < dst_w; x++) {
+            int sx, sy;
+            unrotate(x, y, width, height, rotation, sx, sy);
+            if (memcmp(&out[((size_t) y * dst_w + x) * 4], &src[sy * stride + sx * 4], 4) != 0) {
+                CHECK(false, "%dx%d pad %d rot %d: pixel (%d, %d)", width, height, pad_pixels, rotation, x, y);
+                return;
+            }
+        }
+    }
+    for (size_t i = n; i < out.size(); i++) {
+        CHECK(out[i] == 0xA5, "%dx%d rot %d: wrote past the end at byte %zu", width, height, rotation, i);
+    }
+}
+
+// A JPEG header with an optional JFIF APP0 ahead of an APP1 Exif block whose IFD0 holds a couple
+// of other tags around Orientation, then SOS. Big-endian ("MM") or little-endian ("II") TIFF.
+static std::vector<uint8_t> make_jpeg(int orientation, bool little_endian, bool with_app0) {
+    std::vector<uint8_t> tiff;
+    auto u16 = [&](uint32_t v) {
+        if (little_endian) { tiff.push_back(v & 0xff); tiff.push_back(v >> 8); }
+        else               { tiff.push_back(v >> 8);   tiff.push_back(v & 0xff); }
+    };
+    auto u32 = [&](uint32_t v) {
+        if (little_endian) { u16(v & 0xffff); u16(v >> 16); }
+        else               { u16(v >> 16);    u16(v & 0xffff); }
+    };
+    tiff.push_back(little_endian ? 'I' : 'M');
+    tiff.push_back(little_endian ? 'I' : 'M');
+    u16(42);
+    u32(8); // IFD0 right after the header
+    u16(3);
+    u16(0x010F); u16(2); u32(4); u32(0x41424300);           // Make, "ABC"
+    u16(0x0112); u16(3); u32(1); u16(orientation); u16(0);  // Orientation, SHORT
+    u16(0x011A); u16(5); u32(1); u32(0);                    // XResolution, offset unused
+    u32(0);
+
+    std::vector<uint8_t> jpeg = { 0xFF, 0xD8 };
+    auto segment = [&](uint8_t marker, const std::vector<uint8_t> & payload) {
+        const size_t len = payload.size() + 2;
+        jpeg.insert(jpeg.end(), { 0xFF, marker, (uint8_t) (len >> 8), (uint8_t) len });
+        jpeg.insert(jpeg.end(), payload.begin(), payload.end());
+    };
+    if (with_app0) {
+        segment(0xE0, { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 });
+    }
+    std::vector<uint8_t> exif = { 'E', 'x', 'i', 'f', 0, 0 };
+    exif.insert(exif.end(), tiff.begin(), tiff.end());
+    segment(0xE1, exif);
+    segment(0xDA, { 1, 1, 0, 0, 0x3F, 0 });
+    jpeg.insert(jpeg.end(), { 0x12, 0x34, 0xFF, 0xD9 });
+    return jpeg;
+}
+
+static void check_exif() {
+    for (int orientation = 1; orientation <= 8; orientation++) {
+        for (bool le : { false, true }) {
+            for (bool app0 : { false, true }) {
+                const std::vector<uint8_t> jpeg = make_jpeg(orientation, le, app0);
+                const int got = jpeg_exif_orientation(jpeg.data(), jpeg.size());
+                CHECK(got == orientation, "orientation %d (%s, app0 %d) read as %d",
+                      orientation, le ? "II" : "MM", app0, got);
+            }
+        }
+    }
+
+    // Out-of-range values and non-JPEG data report none
+    std::vector<uint8_t> jpeg = make_jpeg(9, true, false);
+    CHECK(jpeg_exif_orientation(jpeg.data(), jpeg.size()) == 0, "orientation 9 accepted");
+    jpeg = make_jpeg(0, false, true);
+    CHECK(jpeg_exif_orientation(jpeg.data(), jpeg.size()) == 0, "orientation 0 accepted");
+    const uint8_t png[] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    CHECK(jpeg_exif_orientation(png, sizeof(png)) == 0, "PNG read as a JPEG");
+
+    // Exif after the start of scan is image data, not metadata
+    const std::vector<uint8_t> tagged = make_jpeg(6, true, false);
+    std::vector<uint8_t> late = { 0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x08, 1, 1, 0, 0, 0x3F, 0 };
+    late.insert(late.end(), tagged.begin() + 2, tagged.end());
+    CHECK(jpeg_exif_orientation(late.data(), late.size()) == 0, "Exif after SOS read");
+
+    // Every truncation stays inside the buffer and never reports a wrong value; a copy of exactly
+    // the truncated size means an overrun would read past the allocation
+    const std::vector<uint8_t> full = make_jpeg(6, false, true);
+    for (size_t n = 0; n < full.size(); n++) {
+        const std::vector<uint8_t> cut(full.begin(), full.begin() + n);
+        const int got = jpeg_exif_orientation(cut.data(), cut.size());
+        CHECK(got == 0 || got == 6, "cut to %zu bytes read as %d", n, got);
+    }
+
+    // An IFD entry count larger than the segment stops at the segment's end
+    std::vector<uint8_t> overrun = make_jpeg(3, true, false);
+    const size_t ifd = 2 + 4 + 6 + 8; // SOI, APP1 header, "Exif\0\0", TIFF header
+    overrun[ifd] = 0xFF;
+    overrun[ifd + 1] = 0xFF;
+    const int got = jpeg_exif_orientation(overrun.data(), overrun.size());
+    CHECK(got == 0 || got == 3, "oversized IFD read as %d", got);
+}
+
+int main() {
+#if defined(__ARM_NEON)
+    printf("rgba_to_rgb: NEON path\n");
+#elif defined(__SSSE3__)
+    printf("rgba_to_rgb: SSSE3 path\n");
+#else
+    printf("rgba_to_rgb: scalar path only\n");
+#endif
+
+    std::mt19937 rng(1234);
+    // Every tail length around one, two and several 16-pixel blocks
+    for (size_t n = 0; n <= 67; n++) {
+        check_out_of_place(rng, n);
+        check_in_place(rng, n);
+    }
+    for (size_t n : { 255u, 256u, 257u, 511u * 383u, 512u * 384u }) {
+        check_out_of_place(rng, n);
+        check_in_place(rng, n);
+    }
+    for (int width : { 1, 3, 15, 17, 31, 33, 383, 511 }) {
+        check_rows(rng, width, 7, 0);
+        check_rows(rng, width, 7, 12);
+    }
+
+    // YUV: odd and even sizes, row padding, planar and interleaved chroma, every rotation, at
+    // the source size, downscaled and upscaled
+    for (int ps : { 1, 2 }) {
+        for (int pad : { 0, 13 }) {
+            for (int rotation : { 0, 90, 180, 270 }) {
+                for (auto [w, h] : { std::pair{ 16, 8 }, { 17, 9 }, { 33, 7 }, { 1, 1 }, { 3, 5 }, { 640, 480 } }) {
+                    const bool transpose = rotation == 90 || rotation == 270;
+                    const int rw = transpose ? h : w, rh = transpose ? w : h;
+                    check_yuv(rng, w, h, ps, pad, rw, rh, rotation);
+                    check_yuv(rng, w, h, ps, pad, std::max(1, rw / 3), std::max(1, rh / 2), rotation);
+                    check_yuv(rng, w, h, ps, pad, rw * 2 + 1, rh + 3, rotation);
+                }
+            }
+        }
+    }
+    check_yuv_colours();
+
+    for (int rotation : { 0, 90, 180, 270 }) {
+        for (auto [w, h] : { std::pair{ 1, 1 }, { 7, 3 }, { 16, 16 }, { 33, 17 }, { 640, 480 } }) {
+            check_rotate(rng, w, h, 0, rotation);
+            check_rotate(rng, w, h, 5, rotation);
+        }
+    }
+
+    check_exif();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("image_convert_test: OK\n");
+    return 0;
+}
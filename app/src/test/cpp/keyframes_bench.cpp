@@ -0,0 +1,149 @@
+// Keyframe selection on synthetic clips against the evenly spaced frames extractFrames() used
+// to take. Each clip is VIDEO_CANDIDATE_FRAMES frames labelled with the scene they show; for
+// both strategies it reports the frames that would reach the encoder and how many scenes they
+// cover, plus the cost of signing and selecting.
+
+#include "bench.h"
+#include "keyframes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Mirrors LlamaModel.VIDEO_CANDIDATE_FRAMES / VIDEO_NUM_FRAMES and KEYFRAME_MIN_CHANGE
+static constexpr size_t N_CANDIDATES = 12;
+static constexpr size_t K            = 3;
+static constexpr float  MIN_CHANGE   = 0.015f;
+
+static constexpr int WIDTH  = 512;
+static constexpr int HEIGHT = 288;
+
+struct Clip {
+    std::string name;
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<int> scene;
+};
+
+static std::vector<uint8_t> solid(int r, int g, int b, std::mt19937 & rng, int noise) {
+    std::vector<uint8_t> f((size_t) WIDTH * HEIGHT * 4);
+    std::uniform_int_distribution<int> jitter(-noise, noise);
+    for (size_t i = 0; i < f.size(); i += 4) {
+        f[i + 0] = (uint8_t) std::clamp(r + jitter(rng), 0, 255);
+        f[i + 1] = (uint8_t) std::clamp(g + jitter(rng), 0, 255);
+        f[i + 2] = (uint8_t) std::clamp(b + jitter(rng), 0, 255);
+        f[i + 3] = 255;
+    }
+    return f;
+}
+
+static void square(std::vector<uint8_t> & f, int x0, int y0, int side) {
+    for (int y = y0; y < std::min(HEIGHT, y0 + side); y++) {
+        for (int x = x0; x < std::min(WIDTH, x0 + side); x++) {
+            uint8_t * p = &f[((size_t) y * WIDTH + x) * 4];
+            p[0] = p[1] = p[2] = 250;
+        }
+    }
+}
+
+// Scenes of the given lengths, each a different colour
+static Clip cuts(const std::string & name, const std::vector<size_t> & lengths, std::mt19937 & rng) {
+    static const int colours[][3] = { { 60, 90, 120 }, { 200, 40, 40 }, { 20, 200, 40 }, { 240, 240, 0 } };
+    Clip clip{ name, {}, {} };
+    for (size_t s = 0; s < lengths.size(); s++) {
+        for (size_t i = 0; i < lengths[s]; i++) {
+            clip.frames.push_back(solid(colours[s][0], colours[s][1], colours[s][2], rng, 3));
+            clip.scene.push_back((int) s);
+        }
+    }
+    return clip;
+}
+
+static std::vector<Clip> synthetic_clips() {
+    std::mt19937 rng(7);
+    std::vector<Clip> clips;
+    clips.push_back(cuts("static", { N_CANDIDATES }, rng));
+    clips.push_back(cuts("late cut", { 10, 2 }, rng));
+    clips.push_back(cuts("3 scenes", { 4, 1, 7 }, rng));
+    clips.push_back(cuts("4 scenes", { 2, 7, 1, 2 }, rng));
+
+    // A bright square crossing a still background; its scene is which third of the frame it is in
+    Clip moving{ "moving", {}, {} };
+    for (size_t i = 0; i < N_CANDIDATES; i++) {
+        std::vector<uint8_t> f = solid(60, 90, 120, rng, 3);
+        const int x = (int) (i * (WIDTH - 60) / (N_CANDIDATES - 1));
+        square(f, x, 100, 60);
+        moving.frames.push_back(std::move(f));
+        moving.scene.push_back(std::min(2, (x + 30) * 3 / WIDTH));
+    }
+    clips.push_back(std::move(moving));
+    return clips;
+}
+
+// The frames the previous extractFrames() decoded: K evenly spaced over the clip
+static std::vector<size_t> evenly_spaced(size_t n, size_t k) {
+    std::vector<size_t> picks;
+    for (size_t i = 0; i < k; i++) {
+        picks.push_back((2 * i + 1) * n / (2 * k));
+    }
+    return picks;
+}
+
+static size_t scenes_covered(const Clip & clip, const std::vector<size_t> & picks) {
+    std::set<int> seen;
+    for (size_t i : picks) {
+        seen.insert(clip.scene[i]);
+    }
+    return seen.size();
+}
+
+static std::string format_picks(const std::vector<size_t> & picks) {
+    std::string s;
+    for (size_t i : picks) {
+        s += (s.empty() ? "" : " ") + std::to_string(i);
+    }
+    return s;
+}
+
+int main(int argc, char ** argv) {
+    const int iterations = bench_iterations(argc, argv, 200);
+    const std::vector<Clip> clips = synthetic_clips();
+
+    printf("%zu candidate frames of %dx%d, up to %zu encoded\n", N_CANDIDATES, WIDTH, HEIGHT, K);
+    printf("%-10s %7s | %-10s %6s %6s | %-10s %6s %6s | %8s\n", "clip", "scenes",
+           "even", "frames", "scenes", "keyframes", "frames", "scenes", "us");
+
+    int failures = 0;
+    for (const Clip & clip : clips) {
+        std::vector<size_t> picks;
+        const double us = bench_median_us(iterations, [&] {
+            std::vector<FrameSignature> sigs(clip.frames.size());
+            for (size_t i = 0; i < clip.frames.size(); i++) {
+                frame_signature(sigs[i], clip.frames[i].data(), WIDTH, HEIGHT, (size_t) WIDTH * 4);
+            }
+            picks = select_keyframes(sigs, K, MIN_CHANGE);
+        });
+        const std::vector<size_t> even = evenly_spaced(clip.frames.size(), K);
+
+        const size_t n_scenes      = std::set<int>(clip.scene.begin(), clip.scene.end()).size();
+        const size_t even_scenes   = scenes_covered(clip, even);
+        const size_t picked_scenes = scenes_covered(clip, picks);
+        printf("%-10s %7zu | %-10s %6zu %6zu | %-10s %6zu %6zu | %8.0f\n", clip.name.c_str(), n_scenes,
+               format_picks(even).c_str(), even.size(), even_scenes,
+               format_picks(picks).c_str(), picks.size(), picked_scenes, us);
+
+        // Never worse coverage than even spacing, and a static clip is encoded once
+        if (picked_scenes < std::min(even_scenes, K)) {
+            fprintf(stderr, "FAIL %s: keyframes cover %zu scenes, even spacing %zu\n",
+                    clip.name.c_str(), picked_scenes, even_scenes);
+            failures++;
+        }
+        if (n_scenes == 1 && picks.size() != 1) {
+            fprintf(stderr, "FAIL %s: static clip gave %zu keyframes\n", clip.name.c_str(), picks.size());
+            failures++;
+        }
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+// Session files must round-trip every field, and any file save_session could not have written
+// (another version, cut short, trailing bytes, an inconsistent window) must be rejected whole.
+// The KV state is an opaque blob here, standing in for llama_state_seq_get_data.
+
+#include "session_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);  \
+            fprintf(stderr, __VA_ARGS__);                  \
+            fprintf(stderr, "\n");                         \
+            failures++;                                    \
+        }                                                  \
+    } while (0)
+
+static SessionFile sample_session() {
+    SessionFile s;
+    s.image_hashes = { 0x0123456789abcdefull, 42 };
+    s.seed         = 0xdeadbeef;
+    s.n_past       = 812;
+    s.recent       = { 1, 2, 3, 151645, -1 };
+    s.turn_start   = { 14, 380, 601 };
+    s.max_turns    = 3;
+    s.max_reply    = 256;
+    s.messages     = {
+        { "user", "<__image__>\nWhat is on the table?" },
+        { "assistant", "A cup of coffee and a notebook." },
+        { "user", "What colour is the cup?" },
+        { "assistant", "" },
+        { "user", "Anything written on it?\n\xe2\x9c\x93" },
+        { "assistant", "No." },
+    };
+    s.state.resize(4099);
+    for (size_t i = 0; i < s.state.size(); i++) {
+        s.state[i] = (uint8_t) (i * 131 + 7);
+    }
+    return s;
+}
+
+static bool same(const SessionFile & a, const SessionFile & b) {
+    return a.image_hashes == b.image_hashes && a.seed == b.seed && a.n_past == b.n_past &&
+           a.recent == b.recent && a.turn_start == b.turn_start && a.max_turns == b.max_turns &&
+           a.max_reply == b.max_reply && a.messages == b.messages && a.state == b.state;
+}
+
+static std::vector<uint8_t> load_bytes(const std::string & path) {
+    std::vector<uint8_t> bytes;
+    FILE * f = fopen(path.c_str(), "rb");
+    if (!f) return bytes;
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        bytes.push_back((uint8_t) c);
+    }
+    fclose(f);
+    return bytes;
+}
+
+static void store_bytes(const std::string & path, const std::vector<uint8_t> & bytes, size_t n) {
+    FILE * f = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, n, f);
+    fclose(f);
+}
+
+// A rejected read must leave the destination as it was
+static SessionReadStatus read_untouched(const std::string & path, const char * what) {
+    SessionFile out;
+    out.seed = 7;
+    uint32_t version = 0;
+    const SessionReadStatus status = read_session_file(path, out, version);
+    if (status != SessionReadStatus::OK) {
+        CHECK(out.seed == 7 && out.messages.empty() && out.state.empty(), "%s: rejected read changed the output", what);
+    }
+    return status;
+}
+
+static void check_round_trip(const std::string & path) {
+    const SessionFile in = sample_session();
+    CHECK(write_session_file(path, in), "write failed");
+    FILE * tmp = fopen((path + ".tmp").c_str(), "rb");
+    CHECK(tmp == nullptr, "temporary file left behind");
+    if (tmp) fclose(tmp);
+
+    SessionFile out;
+    uint32_t version = 0;
+    CHECK(read_session_file(path, out, version) == SessionReadStatus::OK, "read failed");
+    CHECK(version == SESSION_VERSION, "version %u", version);
+    CHECK(same(in, out), "fields differ after the round trip");
+
+    // No window (turn_start empty) is valid too
+    SessionFile plain = sample_session();
+    plain.turn_start.clear();
+    plain.max_turns = 0;
+    CHECK(write_session_file(path, plain), "write without a window failed");
+    CHECK(read_session_file(path, out, version) == SessionReadStatus::OK && same(plain, out),
+          "session without a window did not round-trip");
+}
+
+static void check_header(const std::string & path) {
+    CHECK(write_session_file(path, sample_session()), "write failed");
+    const std::vector<uint8_t> good = load_bytes(path);
+
+    std::vector<uint8_t> bytes = good;
+    const uint32_t v1 = 1;
+    memcpy(bytes.data() + 4, &v1, sizeof(v1));
+    store_bytes(path, bytes, bytes.size());
+    SessionFile out;
+    uint32_t version = 0;
+    CHECK(read_session_file(path, out, version) == SessionReadStatus::WRONG_VERSION && version == 1,
+          "version 1 file not reported as such (version %u)", version);
+
+    bytes = good;
+    bytes[0] ^= 0xff;
+    store_bytes(path, bytes, bytes.size());
+    CHECK(read_untouched(path, "wrong magic") == SessionReadStatus::INVALID, "wrong magic accepted");
+
+    bytes = good;
+    bytes.push_back(0);
+    store_bytes(path, bytes, bytes.size());
+    CHECK(read_untouched(path, "trailing byte") == SessionReadStatus::INVALID, "trailing byte accepted");
+
+    std::remove(path.c_str());
+    CHECK(read_untouched(path, "missing") == SessionReadStatus::MISSING, "missing file not reported");
+}
+
+// Every prefix of a valid file, down to the empty file
+static void check_truncated(const std::string & path) {
+    CHECK(write_session_file(path, sample_session()), "write failed");
+    const std::vector<uint8_t> good = load_bytes(path);
+    for (size_t n = 0; n < good.size(); n++) {
+        store_bytes(path, good, n);
+        if (read_untouched(path, "truncated") != SessionReadStatus::INVALID) {
+            CHECK(false, "file cut to %zu of %zu bytes accepted", n, good.size());
+            return;
+        }
+    }
+}
+
+static void check_inconsistent(const std::string & path) {
+    struct Case {
+        const char * what;
+        void (*edit)(SessionFile &);
+    };
+    const Case cases[] = {
+        { "no image hash",          [](SessionFile & s) { s.image_hashes.clear(); } },
+        { "negative n_past",        [](SessionFile & s) { s.n_past = -1; } },
+        { "zero max_reply",         [](SessionFile & s) { s.max_reply = 0; } },
+        { "no messages",            [](SessionFile & s) { s.messages.clear(); s.turn_start.clear(); } },
+        { "ends on a question",     [](SessionFile & s) { s.messages.push_back({ "user", "?" }); } },
+        { "unsorted turn starts",   [](SessionFile & s) { s.turn_start = { 14, 601, 380 }; } },
+        { "negative turn start",    [](SessionFile & s) { s.turn_start[0] = -1; } },
+        { "turn start past n_past", [](SessionFile & s) { s.turn_start.back() = s.n_past; } },
+        { "more turns than pairs",  [](SessionFile & s) { s.turn_start.push_back(700); } },
+        { "empty state",            [](SessionFile & s) { s.state.clear(); } },
+    };
+    for (const Case & c : cases) {
+        SessionFile s = sample_session();
+        c.edit(s);
+        CHECK(write_session_file(path, s), "%s: write failed", c.what);
+        CHECK(read_untouched(path, c.what) == SessionReadStatus::INVALID, "%s: accepted", c.what);
+    }
+}
+
+int main() {
+    const std::string path = "session_file_test.bin";
+
+    check_round_trip(path);
+    check_header(path);
+    check_truncated(path);
+    check_inconsistent(path);
+    std::remove(path.c_str());
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("session_file_test: OK\n");
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Visual token merging on synthetic encoder output: a 16x16 patch grid where most patches
+// are near-duplicates of a few background regions and a handful show distinct objects, as in
+// a typical camera frame. For each keep ratio it reports the merge time, the share of prefill
+// left (prefill cost is linear in the visual tokens), and how well the survivors still cover
+// every original token. Prefill time and caption agreement proper need the model on a device:
+// set the ratio with setTokenKeepRatio and compare the PHOTO BENCHMARK lines and captions.
+
+#include "bench.h"
+#include "token_merge.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static constexpr size_t GRID      = 16;
+static constexpr size_t N_TOKENS  = GRID * GRID;
+static constexpr size_t N_EMBD    = 2048;
+static constexpr size_t N_REGIONS = 6;
+static constexpr size_t N_OBJECTS = 8;
+
+static std::vector<float> random_unit(std::mt19937 & rng) {
+    std::normal_distribution<float> normal;
+    std::vector<float> v(N_EMBD);
+    float norm = 0.0f;
+    for (float & x : v) {
+        x = normal(rng);
+        norm += x * x;
+    }
+    for (float & x : v) {
+        x /= std::sqrt(norm);
+    }
+    return v;
+}
+
+static float cosine(const float * a, const float * b) {
+    float dot = 0.0f, na = 0.0f, nb = 0.0f;
+    for (size_t k = 0; k < N_EMBD; k++) {
+        dot += a[k] * b[k];
+        na  += a[k] * a[k];
+        nb  += b[k] * b[k];
+    }
+    return dot / std::sqrt(na * nb + 1e-12f);
+}
+
+// Background patches take the region of their horizontal band plus noise; object patches get
+// their own direction. Returns the object patch indices.
+static std::vector<size_t> synthetic_frame(std::vector<float> & embd, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 0.15f / std::sqrt((float) N_EMBD));
+    std::vector<std::vector<float>> regions;
+    for (size_t r = 0; r < N_REGIONS; r++) {
+        regions.push_back(random_unit(rng));
+    }
+
+    embd.assign(N_TOKENS * N_EMBD, 0.0f);
+    for (size_t t = 0; t < N_TOKENS; t++) {
+        const std::vector<float> & region = regions[(t / GRID) * N_REGIONS / GRID];
+        for (size_t k = 0; k < N_EMBD; k++) {
+            embd[t * N_EMBD + k] = region[k] + noise(rng);
+        }
+    }
+
+    std::vector<size_t> objects;
+    for (size_t o = 0; o < N_OBJECTS; o++) {
+        const size_t t = (o * 37 + 11) % N_TOKENS;
+        const std::vector<float> obj = random_unit(rng);
+        std::copy(obj.begin(), obj.end(), &embd[t * N_EMBD]);
+        objects.push_back(t);
+    }
+    return objects;
+}
+
+// Cosine of `token` to the closest of the `n_kept` survivors
+static float best_match(const float * token, const std::vector<float> & kept, size_t n_kept) {
+    float best = -1.0f;
+    for (size_t i = 0; i < n_kept; i++) {
+        best = std::max(best, cosine(token, &kept[i * N_EMBD]));
+    }
+    return best;
+}
+
+int main(int argc, char ** argv) {
+    const int iterations = bench_iterations(argc, argv, 100);
+
+    std::vector<float> original;
+    const std::vector<size_t> objects = synthetic_frame(original, 42);
+
+    printf("%zu tokens x %zu dims, %zu background regions, %zu object tokens\n",
+           N_TOKENS, N_EMBD, N_REGIONS, N_OBJECTS);
+    printf("keep   tokens   merge us   prefill   mean cover   min object cover\n");
+
+    bool objects_kept = true;
+    for (float ratio : { 1.0f, 0.75f, 0.5f, 0.25f, 0.1f }) {
+        const size_t n_keep = std::max<size_t>(1, (size_t) std::lround(N_TOKENS * ratio));
+        std::vector<float> embd;
+        size_t n_left = 0;
+        const double us = bench_median_us(iterations, [&] {
+            embd = original;
+            n_left = merge_tokens(embd.data(), N_TOKENS, N_EMBD, n_keep);
+            bench_keep(embd.data());
+        });
+
+        double cover = 0.0;
+        for (size_t t = 0; t < N_TOKENS; t++) {
+            cover += best_match(&original[t * N_EMBD], embd, n_left);
+        }
+        float object_cover = 1.0f;
+        for (size_t t : objects) {
+            object_cover = std::min(object_cover, best_match(&original[t * N_EMBD], embd, n_left));
+        }
+
+        printf("%4.2f   %6zu   %8.0f   %6.0f%%   %10.3f   %16.3f\n", ratio, n_left, us,
+               100.0 * n_left / N_TOKENS, cover / N_TOKENS, object_cover);
+
+        // Redundant background must go first: distinct objects survive down to a quarter
+        if (ratio >= 0.25f && object_cover < 0.99f) {
+            objects_kept = false;
+        }
+    }
+
+    if (!objects_kept) {
+        fprintf(stderr, "FAIL: an object token was merged away before the background\n");
+        return 1;
+    }
+    return 0;
+}
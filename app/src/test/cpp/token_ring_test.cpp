@@ -0,0 +1,175 @@
+// TokenRing under a real producer and consumer thread: bytes arrive intact and in order across
+// the wrap-around, close() lets the consumer drain before it sees the end, and abandon()
+// releases a producer stuck on a full ring.
+
+#include "token_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                        \
+    do {                                                        \
+        if (!(cond)) {                                          \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                       \
+            fprintf(stderr, "\n");                              \
+            failures++;                                         \
+        }                                                       \
+    } while (0)
+
+// Byte i of the stream, so the consumer can tell a lost, repeated or reordered byte
+static char stream_byte(uint64_t i) {
+    return (char) ((i * 2654435761u) >> 13);
+}
+
+// A thread that does not finish is a deadlock; report it instead of hanging ctest
+template <typename F>
+static void finish_or_die(std::future<F> & f, const char * what) {
+    if (f.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+        fprintf(stderr, "FAIL: %s did not finish\n", what);
+        std::_Exit(1);
+    }
+}
+
+// Producer pushes random chunk sizes, some larger than the ring; the consumer takes random
+// partial amounts, so both indexes wrap at every offset
+static void check_stream(size_t capacity, uint64_t total, unsigned seed) {
+    TokenRing ring(capacity);
+
+    auto producer = std::async(std::launch::async, [&] {
+        std::mt19937 rng(seed);
+        std::vector<char> chunk;
+        uint64_t sent = 0;
+        while (sent < total) {
+            const size_t n = std::min<uint64_t>(total - sent, 1 + rng() % (capacity * 2));
+            chunk.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                chunk[i] = stream_byte(sent + i);
+            }
+            ring.push(chunk.data(), n);
+            sent += n;
+            if (rng() % 8 == 0) {
+                std::this_thread::yield();
+            }
+        }
+        ring.close();
+    });
+
+    auto consumer = std::async(std::launch::async, [&] {
+        std::mt19937 rng(seed + 1);
+        uint64_t received = 0;
+        bool ordered = true;
+        for (;;) {
+            const int64_t n = ring.wait_readable(50);
+            if (n < 0) {
+                break;
+            }
+            const size_t take = n == 0 ? 0 : 1 + rng() % (size_t) n;
+            for (size_t i = 0; i < take && ordered; i++) {
+                const char got = (char) ring.data()[(received + i) % ring.capacity()];
+                if (got != stream_byte(received + i)) {
+                    fprintf(stderr, "byte %llu: got %d\n", (unsigned long long) (received + i), got);
+                    ordered = false;
+                }
+            }
+            ring.consume(take);
+            received += take;
+        }
+        return ordered ? received : UINT64_MAX;
+    });
+
+    finish_or_die(producer, "producer");
+    finish_or_die(consumer, "consumer");
+    const uint64_t received = consumer.get();
+    CHECK(received == total, "capacity %zu: received %llu of %llu bytes", capacity,
+          (unsigned long long) received, (unsigned long long) total);
+}
+
+// Everything pushed before close() is still delivered, then the end is reported for good
+static void check_close_drains() {
+    TokenRing ring(16);
+    ring.push("abcdefghij", 10);
+    ring.close();
+
+    CHECK(ring.wait_readable(0) == 10, "closed ring must still report its bytes");
+    CHECK(memcmp(ring.data(), "abcdefghij", 10) == 0, "closed ring lost its bytes");
+    ring.consume(4);
+    CHECK(ring.wait_readable(0) == 6, "partial consume after close");
+    ring.consume(6);
+    CHECK(ring.wait_readable(0) == -1, "drained closed ring must report the end");
+    CHECK(ring.wait_readable(0) == -1, "the end is sticky");
+}
+
+// A sleeping consumer is woken by close() rather than sleeping out its timeout
+static void check_close_wakes() {
+    TokenRing ring(16);
+    auto consumer = std::async(std::launch::async, [&] {
+        const auto t0 = std::chrono::steady_clock::now();
+        const int64_t n = ring.wait_readable(5000);
+        return std::make_pair(n, std::chrono::steady_clock::now() - t0);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ring.close();
+
+    finish_or_die(consumer, "consumer waiting on close");
+    const auto result = consumer.get();
+    CHECK(result.first == -1, "close on an empty ring must report the end, got %lld", (long long) result.first);
+    CHECK(result.second < std::chrono::seconds(2), "close did not wake the consumer");
+}
+
+static void check_timeout() {
+    TokenRing ring(16);
+    CHECK(ring.wait_readable(10) == 0, "open empty ring must time out with 0");
+}
+
+// The consumer stops reading with the ring full: abandon() lets the producer finish
+static void check_abandon() {
+    TokenRing ring(32);
+    std::atomic<bool> returned{ false };
+    auto producer = std::async(std::launch::async, [&] {
+        std::vector<char> bytes(4096, 'x');
+        ring.push(bytes.data(), bytes.size());
+        returned.store(true);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!returned.load(), "producer must wait on a full ring until abandoned");
+    CHECK(ring.wait_readable(0) == 32, "ring should be full");
+
+    ring.abandon();
+    finish_or_die(producer, "producer after abandon");
+    CHECK(returned.load(), "abandon did not release the producer");
+
+    // Later pushes return at once as well
+    auto again = std::async(std::launch::async, [&] { ring.push("more", 4); });
+    finish_or_die(again, "push after abandon");
+}
+
+int main() {
+    check_close_drains();
+    check_close_wakes();
+    check_timeout();
+    check_abandon();
+
+    unsigned seed = 1;
+    for (size_t capacity : { 1, 2, 7, 64, 4096 }) {
+        check_stream(capacity, 1 << 18, seed++);
+    }
+    check_stream(4096, 1 << 24, seed++);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failure(s)\n", failures);
+        return 1;
+    }
+    printf("token_ring_test: OK\n");
+    return 0;
+}